@@ -9,10 +9,80 @@
 
 #include "ProcedualCollapseMode.generated.h"
 
+class UTexture2D;
+
 /* \/ ======================= \/ *\
 |  \/ UProcedualCollapseMode  \/  |
 \* \/ ======================= \/ */
 
+/**
+ * An immutable copy of the settings of a collapse mode. Safe to use off the game thread.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainCollapseModeConfig
+{
+	//The transform of the terrain this is collapsing.
+	FTransform TerrainTransform = FTransform();
+
+	virtual ~FTerrainCollapseModeConfig()
+	{
+
+	}
+
+	/** 
+	 * Gets the next super position to collapse on the given shape.
+	 * 
+	 * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @return Whether or not another collapse is needed.
+	 */
+	virtual bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const;
+
+	/**
+	 * Gets the next super positions to collapse on the given shape. Every superposition after the first must be independent of the ones before it. Only chooses one by default.
+	 *
+	 * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @param MaxBatchSize - The most superpositions to choose.
+	 * @return Whether or not another collapse is needed after these.
+	 */
+	virtual bool GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const;
+
+	/**
+	 * Gets the spawnable tile this mode must place, if any.
+	 *
+	 * @return The index of the spawnable tile to place, or INDEX_NONE if any variant may be placed.
+	 */
+	virtual int GetRequiredTileIndex() const;
+
+	/**
+	 * Determines whether this mode may ever collapse a socket at a location. Sockets outside are frozen while this mode runs. Includes everywhere by default.
+	 *
+	 * @param SocketLocation - The midpoint of the socket, in terrain space.
+	 * @return Whether or not the location is inside of the bounds of this mode.
+	 */
+	virtual bool IsInBounds(const FVector2D SocketLocation) const;
+
+	/**
+	 * Determines whether the worker should keep the active sockets sorted by GetSocketOrder for this mode. Off by default.
+	 *
+	 * @return Whether or not this mode chooses sockets from FTerrainCollapseContext::OrderedSockets.
+	 */
+	virtual bool UsesSocketOrder() const;
+
+	/**
+	 * Gets where a socket is in the order sockets are collapsed in. Must only depend on the socket's own vertices, so that it only changes when the socket is refreshed.
+	 *
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param SocketIndex - The socket to order.
+	 * @return The order of the socket. Sockets with lower orders are collapsed first.
+	 */
+	virtual float GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const;
+};
+
 /**
  * A mode determining how superpositions are collapsed.
  */
@@ -27,16 +97,12 @@ public:
 	 */
 	UProcedualCollapseMode();
 
-	/** 
-	 * Gets the next super position to collapse on the given shape.
-	 * 
-	 * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
-	 * @param CurrentShape - The current shape of the terrain.
-	 * @param SuperPositions - The current superposition states of the terrain.
-	 * @param SpawnableTiles - The tiles that can be spawned.
-	 * @return Whether or not another collapse is needed.
+	/**
+	 * Copies the settings of this for the generation worker. Must be called on the game thread.
+	 *
+	 * @return An immutable copy of the settings of this.
 	 */
-	virtual bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FTerrainShape CurrentShape, TArray<TArray<TArray<bool>>> SuperPositions, TArray<FTerrainTileSpawnData> SpawnableTiles, FRandomStream& RandomStream);
+	virtual FTerrainCollapseModeConfigPtr CreateConfig() const;
 
 	/** 
 	 * Draws the bounds of what will be generated by this collapse mode.
@@ -103,6 +169,39 @@ private:
 |  \/ UManualCollapseMode  \/  |
 \* \/ ==================== \/ */
 
+/**
+ * The settings of a UManualCollapseMode.
+ */
+struct PROCEDUALTERRAINTOOL_API FManualCollapseModeConfig : public FTerrainCollapseModeConfig
+{
+	//The location to collapse the superposition at, in world space.
+	FVector CollapseLocation = FVector::ZeroVector;
+
+	//Whether or not there is a location to collapse at.
+	bool bHasCollapseLocation = false;
+
+	//The index of the tile to add.
+	int TileIndex = 0;
+
+	/**
+	 * Gets the next super position to collapse on the given shape. Will collapse at the collapse location.
+	 *
+	 * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @return Whether or not another collapse is needed.
+	 */
+	virtual bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const override;
+
+	/**
+	 * Gets the spawnable tile this mode must place.
+	 *
+	 * @return The index of the spawnable tile to place.
+	 */
+	virtual int GetRequiredTileIndex() const override;
+};
+
 /**
  * Collapses 1 superposition at a time at a given location.
  */
@@ -118,15 +217,11 @@ class PROCEDUALTERRAINTOOL_API UManualCollapseMode : public UProcedualCollapseMo
 
 public:
 	/**
-	 * Gets the next super position to collapse on the given shape. Will collapse at the location of the CollapseLocationMarker.
+	 * Copies the settings of this for the generation worker. Will collapse at the location of the CollapseLocationMarker.
 	 *
-	 * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
-	 * @param CurrentShape - The current shape of the terrain.
-	 * @param SuperPositions - The current superposition states of the terrain.
-	 * @param SpawnableTiles - The tiles that can be spawned.
-	 * @return Whether or not another collapse is needed.
+	 * @return An immutable copy of the settings of this.
 	 */
-	bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FTerrainShape CurrentShape, TArray<TArray<TArray<bool>>> SuperPositions, TArray<FTerrainTileSpawnData> SpawnableTiles, FRandomStream& RandomStream) override;
+	virtual FTerrainCollapseModeConfigPtr CreateConfig() const override;
 
 	//The location to collapse the superposition at.
 	UPROPERTY(VisibleAnywhere, Meta = (Category = "Generation Mode Settings", MakeEditWidget = "true"))
@@ -148,23 +243,78 @@ public:
 \* \/ ====================== \/ */
 
 /**
- * Collapses superpositions until a circle of a given radius is filled.
+ * The settings of a UCircularCollapseMode.
  */
-UCLASS(Meta = (DisplayName = "Circular"))
-class PROCEDUALTERRAINTOOL_API UCircularCollapseMode : public UProcedualCollapseMode
+struct PROCEDUALTERRAINTOOL_API FCircularCollapseModeConfig : public FTerrainCollapseModeConfig
 {
-	GENERATED_BODY()
+	//The radius of the circle to fill.
+	float Radius = 1000;
+
+	//How strongly to prefer enclosed sockets over sockets close to the center.
+	float CompactGrowthWeight = 0;
+
+	/**
+	 * Gets where a socket is in the order sockets are collapsed in. Mixes the distance to the center with how enclosed the socket is.
+	 *
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param SocketIndex - The socket to order.
+	 * @return The order of the socket. Sockets with lower orders are collapsed first.
+	 */
+	virtual float GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const override;
+
+	/**
+	 * Gets the next super positions to collapse on the given shape. Chooses the closest independent sockets to the center within Radius.
+	 *
+	 * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @param MaxBatchSize - The most superpositions to choose.
+	 * @return Whether or not another collapse is needed after these.
+	 */
+	virtual bool GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const override;
 
 	/** 
 	 * Gets the next super position to collapse on the given shape. Will all superpositions within Radius.
 	 * 
 	 * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
-	 * @param CurrentShape - The current shape of the terrain.
-	 * @param SuperPositions - The current superposition states of the terrain.
-	 * @param SpawnableTiles - The tiles that can be spawned.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
 	 * @return Whether or not another collapse is needed.
 	 */
-	bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FTerrainShape CurrentShape, TArray<TArray<TArray<bool>>> SuperPositions, TArray<FTerrainTileSpawnData> SpawnableTiles, FRandomStream& RandomStream) override;
+	virtual bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const override;
+
+	/**
+	 * Determines whether a location is within Radius.
+	 *
+	 * @param SocketLocation - The midpoint of the socket, in terrain space.
+	 * @return Whether or not the location is inside of the circle.
+	 */
+	virtual bool IsInBounds(const FVector2D SocketLocation) const override;
+
+	/**
+	 * Keeps the active sockets sorted by distance to the center and how enclosed they are.
+	 *
+	 * @return True.
+	 */
+	virtual bool UsesSocketOrder() const override;
+};
+
+/**
+ * Collapses superpositions until a circle of a given radius is filled.
+ */
+UCLASS(Meta = (DisplayName = "Circular"))
+class PROCEDUALTERRAINTOOL_API UCircularCollapseMode : public UProcedualCollapseMode
+{
+	GENERATED_BODY()
+
+	/**
+	 * Copies the settings of this for the generation worker.
+	 *
+	 * @return An immutable copy of the settings of this.
+	 */
+	virtual FTerrainCollapseModeConfigPtr CreateConfig() const override;
 
 	/**
 	 * Draws the bounds of what will be generated by this collapse mode.
@@ -176,6 +326,10 @@ class PROCEDUALTERRAINTOOL_API UCircularCollapseMode : public UProcedualCollapse
 	//The radius of the circle to fill.
 	UPROPERTY(EditAnywhere, Meta = (Category = "Generation Mode Settings"))
 	float Radius = 1000;
+
+	//How strongly to prefer sockets in the gaps of the frontier over sockets close to the center. Keeps the frontier short, which makes every step cheaper. 0 fills strictly outwards from the center.
+	UPROPERTY(EditAnywhere, Meta = (ClampMin = "0", Category = "Generation Mode Settings"))
+	float CompactGrowthWeight = 0;
 };
 
 /* /\ ====================== /\ *\
@@ -189,23 +343,78 @@ class PROCEDUALTERRAINTOOL_API UCircularCollapseMode : public UProcedualCollapse
 \* \/ ========================= \/ */
 
 /**
- * Collapses superpositions until a rectangle of a given bounds is filled.
+ * The settings of a URectangularCollapseMode.
  */
-UCLASS(Meta = (DisplayName = "Rectangular"))
-class PROCEDUALTERRAINTOOL_API URectangularCollapseMode : public UProcedualCollapseMode
+struct PROCEDUALTERRAINTOOL_API FRectangularCollapseModeConfig : public FTerrainCollapseModeConfig
 {
-	GENERATED_BODY()
+	//The extent of the box to fill.
+	FVector2D Extent = FVector2D(2000, 1000);
+
+	//How strongly to prefer enclosed sockets over sockets to the left.
+	float CompactGrowthWeight = 0;
+
+	/**
+	 * Gets where a socket is in the order sockets are collapsed in. Mixes the distance along the box with how enclosed the socket is.
+	 *
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param SocketIndex - The socket to order.
+	 * @return The order of the socket. Sockets with lower orders are collapsed first.
+	 */
+	virtual float GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const override;
+
+	/**
+	 * Gets the next super positions to collapse on the given shape. Chooses the left most independent sockets within a box with the given extent.
+	 *
+	 * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @param MaxBatchSize - The most superpositions to choose.
+	 * @return Whether or not another collapse is needed after these.
+	 */
+	virtual bool GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const override;
 
 	/** 
 	 * Gets the next super position to collapse on the given shape. Will all superpositions within a box with the given extent.
 	 * 
 	 * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
-	 * @param CurrentShape - The current shape of the terrain.
-	 * @param SuperPositions - The current superposition states of the terrain.
-	 * @param SpawnableTiles - The tiles that can be spawned.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
 	 * @return Whether or not another collapse is needed.
 	 */
-	bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FTerrainShape CurrentShape, TArray<TArray<TArray<bool>>> SuperPositions, TArray<FTerrainTileSpawnData> SpawnableTiles, FRandomStream& RandomStream) override;
+	virtual bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const override;
+
+	/**
+	 * Determines whether a location is within the box with the given extent.
+	 *
+	 * @param SocketLocation - The midpoint of the socket, in terrain space.
+	 * @return Whether or not the location is inside of the box.
+	 */
+	virtual bool IsInBounds(const FVector2D SocketLocation) const override;
+
+	/**
+	 * Keeps the active sockets sorted by distance along the box and how enclosed they are.
+	 *
+	 * @return True.
+	 */
+	virtual bool UsesSocketOrder() const override;
+};
+
+/**
+ * Collapses superpositions until a rectangle of a given bounds is filled.
+ */
+UCLASS(Meta = (DisplayName = "Rectangular"))
+class PROCEDUALTERRAINTOOL_API URectangularCollapseMode : public UProcedualCollapseMode
+{
+	GENERATED_BODY()
+
+	/**
+	 * Copies the settings of this for the generation worker.
+	 *
+	 * @return An immutable copy of the settings of this.
+	 */
+	virtual FTerrainCollapseModeConfigPtr CreateConfig() const override;
 
 	/**
 	 * Draws the bounds of what will be generated by this collapse mode.
@@ -217,8 +426,345 @@ class PROCEDUALTERRAINTOOL_API URectangularCollapseMode : public UProcedualColla
 	//The extent of the box to fill.
 	UPROPERTY(EditAnywhere, Meta = (Category = "Generation Mode Settings"))
 	FVector2D Extent = FVector2D(2000, 1000);
+
+	//How strongly to prefer sockets in the gaps of the frontier over sockets to the left. Keeps the frontier short, which makes every step cheaper. 0 fills strictly from left to right.
+	UPROPERTY(EditAnywhere, Meta = (ClampMin = "0", Category = "Generation Mode Settings"))
+	float CompactGrowthWeight = 0;
 };
 
 /* /\ ========================= /\ *\
 |  /\ URectangularCollapseMode  /\  |
 \* /\ ========================= /\ */
+
+
+
+/* \/ =================== \/ *\
+|  \/ USweepCollapseMode  \/  |
+\* \/ =================== \/ */
+
+/**
+ * The settings of a USweepCollapseMode.
+ */
+struct PROCEDUALTERRAINTOOL_API FSweepCollapseModeConfig : public FTerrainCollapseModeConfig
+{
+	//The extent of the box to fill.
+	FVector2D Extent = FVector2D(2000, 1000);
+
+	//The height of each row of the sweep.
+	float RowHeight = 200;
+
+	/**
+	 * Gets the row of the sweep a location is in. Rows are counted up from the bottom of the box.
+	 *
+	 * @param SocketLocation - The location to check, in terrain space.
+	 * @return The row the location is in.
+	 */
+	int GetRow(const FVector2D SocketLocation) const;
+
+	/**
+	 * Gets the next super positions to collapse on the given shape. Chooses the first independent sockets in sweep order on the lowest unfinished rows.
+	 *
+	 * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @param MaxBatchSize - The most superpositions to choose.
+	 * @return Whether or not another collapse is needed after these.
+	 */
+	virtual bool GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const override;
+
+	/**
+	 * Gets the next super position to collapse on the given shape. Will collapse the first socket in sweep order.
+	 *
+	 * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @return Whether or not another collapse is needed.
+	 */
+	virtual bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const override;
+
+	/**
+	 * Determines whether a location is within the box with the given extent.
+	 *
+	 * @param SocketLocation - The midpoint of the socket, in terrain space.
+	 * @return Whether or not the location is inside of the box.
+	 */
+	virtual bool IsInBounds(const FVector2D SocketLocation) const override;
+
+	/**
+	 * Keeps the active sockets sorted in sweep order.
+	 *
+	 * @return True.
+	 */
+	virtual bool UsesSocketOrder() const override;
+
+	/**
+	 * Gets where a socket is in sweep order. Rows are filled from the bottom of the box up, and each row from left to right.
+	 *
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param SocketIndex - The socket to order.
+	 * @return The row of the socket plus how far along the row it is, as a fraction.
+	 */
+	virtual float GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const override;
+};
+
+/**
+ * Collapses superpositions row by row until a box with the given extent is filled. Only looks at the start of the sweep each step, so is much faster than URectangularCollapseMode on large boxes.
+ */
+UCLASS(Meta = (DisplayName = "Sweep"))
+class PROCEDUALTERRAINTOOL_API USweepCollapseMode : public UProcedualCollapseMode
+{
+	GENERATED_BODY()
+
+	/**
+	 * Copies the settings of this for the generation worker.
+	 *
+	 * @return An immutable copy of the settings of this.
+	 */
+	virtual FTerrainCollapseModeConfigPtr CreateConfig() const override;
+
+	/**
+	 * Draws the bounds of what will be generated by this collapse mode.
+	 *
+	 * @param TerrainTransform - The transform to apply to the bounds.
+	 */
+	virtual void DrawGenerationBounds() const override;
+
+	//The extent of the box to fill.
+	UPROPERTY(EditAnywhere, Meta = (Category = "Generation Mode Settings"))
+	FVector2D Extent = FVector2D(2000, 1000);
+
+	//The height of each row of the sweep. Rows about as tall as the tiles keep the frontier shortest.
+	UPROPERTY(EditAnywhere, Meta = (ClampMin = "1", Category = "Generation Mode Settings"))
+	float RowHeight = 200;
+};
+
+/* /\ =================== /\ *\
+|  /\ USweepCollapseMode  /\  |
+\* /\ =================== /\ */
+
+
+
+/* \/ =================== \/ *\
+|  \/ FTerrainRegionGrid  \/  |
+\* \/ =================== \/ */
+
+/**
+ * A region of terrain space rasterized into square cells, so that whether a location is inside of it can be found in constant time.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainRegionGrid
+{
+	//The most cells along each axis. Larger regions use larger cells.
+	static constexpr int MaxResolution = 4096;
+
+	//The corner of the first cell, in terrain space.
+	FVector2D Origin = FVector2D::ZeroVector;
+
+	//The width and height of each cell.
+	float CellSize = 50;
+
+	//The number of cells along each axis.
+	FIntPoint Resolution = FIntPoint::ZeroValue;
+
+	//Whether or not each cell is inside of the region. Indexed by Y * Resolution.X + X.
+	TBitArray<> Cells = TBitArray<>();
+
+	/**
+	 * Creates an empty grid that contains nothing.
+	 */
+	FTerrainRegionGrid()
+	{
+
+	}
+
+	/**
+	 * Creates a grid covering the given bounds with no cells inside of the region.
+	 *
+	 * @param Bounds - The area to cover, in terrain space.
+	 * @param GridCellSize - The width and height of each cell. Increased if the bounds would need more than MaxResolution cells along an axis.
+	 */
+	FTerrainRegionGrid(const FBox2D& Bounds, const float GridCellSize);
+
+	/**
+	 * Adds the inside of a polygon to the region. Self intersecting polygons use the even-odd rule.
+	 *
+	 * @param Points - The corners of the polygon, in terrain space.
+	 */
+	void AddPolygon(const TArray<FVector2D>& Points);
+
+	/**
+	 * Adds the pixels of a texture that are at least as bright as a threshold to the region. Only reads the red channel.
+	 *
+	 * @param Mask - The texture to read. Must have 8 bit grayscale or BGRA source data.
+	 * @param MaskBounds - The area the texture covers, in terrain space. The first pixel is at the minimum corner.
+	 * @param Threshold - The brightness from 0 to 1 a pixel needs to be inside of the region.
+	 */
+	void AddMask(UTexture2D* Mask, const FBox2D& MaskBounds, const float Threshold);
+
+	/**
+	 * Determines whether a location is inside of the region.
+	 *
+	 * @param Location - The location to check, in terrain space.
+	 * @return Whether or not the cell containing the location is inside of the region.
+	 */
+	bool IsInside(const FVector2D Location) const
+	{
+		const int CellX = FMath::FloorToInt((Location.X - Origin.X) / CellSize);
+		const int CellY = FMath::FloorToInt((Location.Y - Origin.Y) / CellSize);
+		return CellX >= 0 && CellY >= 0 && CellX < Resolution.X && CellY < Resolution.Y && Cells[CellY * Resolution.X + CellX];
+	}
+};
+
+/* /\ =================== /\ *\
+|  /\ FTerrainRegionGrid  /\  |
+\* /\ =================== /\ */
+
+
+
+/* \/ ==================== \/ *\
+|  \/ URegionCollapseMode  \/  |
+\* \/ ==================== \/ */
+
+/**
+ * A polygon bounding part of a region to fill.
+ */
+USTRUCT(BlueprintType)
+struct PROCEDUALTERRAINTOOL_API FTerrainRegionPolygon
+{
+	GENERATED_BODY()
+
+	//The corners of the polygon, relative to the terrain generator.
+	UPROPERTY(EditAnywhere, Meta = (Category = "Region"))
+	TArray<FVector2D> Points = TArray<FVector2D>();
+};
+
+/**
+ * The settings of a URegionCollapseMode.
+ */
+struct PROCEDUALTERRAINTOOL_API FRegionCollapseModeConfig : public FTerrainCollapseModeConfig
+{
+	//The region to fill. Shared with the mode that rasterized it rather than copied.
+	TSharedPtr<const FTerrainRegionGrid, ESPMode::ThreadSafe> Region = nullptr;
+
+	/**
+	 * Gets the next super positions to collapse on the given shape. Chooses the independent sockets closest to the center within the region.
+	 *
+	 * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @param MaxBatchSize - The most superpositions to choose.
+	 * @return Whether or not another collapse is needed after these.
+	 */
+	virtual bool GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const override;
+
+	/**
+	 * Gets the next super position to collapse on the given shape. Will collapse the socket closest to the center within the region.
+	 *
+	 * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
+	 * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param RandomStream - The random stream used to choose.
+	 * @return Whether or not another collapse is needed.
+	 */
+	virtual bool GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const override;
+
+	/**
+	 * Determines whether a location is inside of the region.
+	 *
+	 * @param SocketLocation - The midpoint of the socket, in terrain space.
+	 * @return Whether or not the location is inside of the region.
+	 */
+	virtual bool IsInBounds(const FVector2D SocketLocation) const override;
+
+	/**
+	 * Keeps the active sockets sorted by distance to the center.
+	 *
+	 * @return True.
+	 */
+	virtual bool UsesSocketOrder() const override;
+
+	/**
+	 * Gets where a socket is in the order sockets are collapsed in.
+	 *
+	 * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+	 * @param SocketIndex - The socket to order.
+	 * @return The squared distance from the center to the socket.
+	 */
+	virtual float GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const override;
+};
+
+/**
+ * Collapses superpositions until a region made of polygons and a mask texture is filled. The terrain grows outwards from the center, so the region must include the center and parts of it that are not connected to the center are not filled.
+ */
+UCLASS(Meta = (DisplayName = "Region"))
+class PROCEDUALTERRAINTOOL_API URegionCollapseMode : public UProcedualCollapseMode
+{
+	GENERATED_BODY()
+
+	/**
+	 * Copies the settings of this for the generation worker. Rasterizes the region first if it has not been yet or the mask has changed since.
+	 *
+	 * @return An immutable copy of the settings of this.
+	 */
+	virtual FTerrainCollapseModeConfigPtr CreateConfig() const override;
+
+#if WITH_EDITOR
+	/**
+	 * Rasterizes the region again when the polygons, mask or cell size change.
+	 *
+	 * @param PropertyChangedEvent - The property that changed.
+	 */
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+	/**
+	 * Rasterizes the polygons and mask into the cached region.
+	 */
+	void RebuildRegion() const;
+
+	/**
+	 * Gets the identifier of the mask's source data, which changes whenever the source data does.
+	 *
+	 * @return The identifier of the mask's source data, or an invalid identifier if there is no mask.
+	 */
+	FGuid GetMaskSourceId() const;
+
+	/**
+	 * Draws the bounds of what will be generated by this collapse mode.
+	 *
+	 * @param TerrainTransform - The transform to apply to the bounds.
+	 */
+	virtual void DrawGenerationBounds() const override;
+
+	//The polygons to fill.
+	UPROPERTY(EditAnywhere, Meta = (Category = "Generation Mode Settings"))
+	TArray<FTerrainRegionPolygon> Polygons = TArray<FTerrainRegionPolygon>();
+
+	//A texture whose bright pixels are filled as well as the polygons. Must have 8 bit grayscale or BGRA source data.
+	UPROPERTY(EditAnywhere, Meta = (Category = "Generation Mode Settings"))
+	UTexture2D* Mask = nullptr;
+
+	//The extent of the box the mask covers, centered on the terrain generator.
+	UPROPERTY(EditAnywhere, Meta = (Category = "Generation Mode Settings"))
+	FVector2D MaskExtent = FVector2D(2000, 1000);
+
+	//How bright a pixel of the mask needs to be to be filled.
+	UPROPERTY(EditAnywhere, Meta = (ClampMin = "0", ClampMax = "1", Category = "Generation Mode Settings"))
+	float MaskThreshold = 0.5;
+
+	//The size of the cells the region is rasterized into. Smaller cells follow the region more closely but take longer to rasterize.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "1", Category = "Generation Mode Settings"))
+	float CellSize = 50;
+
+	//The rasterized region, shared by every config created from this. Only rebuilt when the settings it is made from change.
+	mutable TSharedPtr<const FTerrainRegionGrid, ESPMode::ThreadSafe> RegionGrid = nullptr;
+
+	//The identifier of the mask's source data when the region was last rasterized.
+	mutable FGuid RegionMaskSourceId = FGuid();
+};
+
+/* /\ ==================== /\ *\
+|  /\ URegionCollapseMode  /\  |
+\* /\ ==================== /\ */
@@ -26,6 +26,57 @@ public:
 		}
 		return Value;
 	};
+
+	/**
+	 * Gets an element of the Luby sequence (1, 1, 2, 1, 1, 2, 4, 1, 1, 2, ...).
+	 *
+	 * @param Index - The zero based index of the element to get.
+	 * @return The element of the Luby sequence at the given index.
+	 */
+	FORCEINLINE static int Luby(int Index)
+	{
+		int SubsequenceSize = 1;
+		int Exponent = 0;
+		while (SubsequenceSize < Index + 1)
+		{
+			Exponent++;
+			SubsequenceSize = 2 * SubsequenceSize + 1;
+		}
+
+		while (SubsequenceSize - 1 != Index)
+		{
+			SubsequenceSize = (SubsequenceSize - 1) >> 1;
+			Exponent--;
+			Index = Index % SubsequenceSize;
+		}
+		return 1 << Exponent;
+	};
+
+	/**
+	 * Generates random bits from a key and a counter with the Philox 4x32-10 counter-based generator. The same key and counter always give the same bits, no matter what was generated before.
+	 *
+	 * @param Key - The key to generate with, such as a seed.
+	 * @param Counter - The counter to generate for, such as a step index.
+	 * @return 32 random bits for the given key and counter.
+	 */
+	FORCEINLINE static uint32 Philox(const uint32 Key, const uint64 Counter)
+	{
+		uint32 State[4] = { (uint32)Counter, (uint32)(Counter >> 32), 0, 0 };
+		uint32 RoundKey[2] = { Key, 0 };
+		for (int Round = 0; Round < 10; Round++)
+		{
+			const uint64 Product0 = (uint64)0xD2511F53 * State[0];
+			const uint64 Product1 = (uint64)0xCD9E8D57 * State[2];
+			State[0] = (uint32)(Product1 >> 32) ^ State[1] ^ RoundKey[0];
+			State[1] = (uint32)Product1;
+			State[2] = (uint32)(Product0 >> 32) ^ State[3] ^ RoundKey[1];
+			State[3] = (uint32)Product0;
+
+			RoundKey[0] += 0x9E3779B9;
+			RoundKey[1] += 0xBB67AE85;
+		}
+		return State[0];
+	};
 };
 
 /**
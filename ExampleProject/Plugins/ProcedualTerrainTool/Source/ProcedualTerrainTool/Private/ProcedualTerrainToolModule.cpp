@@ -2,19 +2,52 @@
 
 #include "ProcedualTerrainToolModule.h"
 
+#include "TerrainGenerator.h"
+#include "HAL/IConsoleManager.h"
+
 #define LOCTEXT_NAMESPACE "ProcedualTerrainToolModule"
 
 void FProcedualTerrainToolModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	Scheduler = new FTerrainGenerationScheduler();
+
+	IConsoleVariable* GenerationThreadsVariable = IConsoleManager::Get().FindConsoleVariable(TEXT("PTT.GenerationThreads"));
+	if (GenerationThreadsVariable)
+	{
+		GenerationThreadsChangedHandle = GenerationThreadsVariable->OnChangedDelegate().AddRaw(this, &FProcedualTerrainToolModule::OnGenerationThreadsChanged);
+	}
 }
 
 void FProcedualTerrainToolModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	IConsoleVariable* GenerationThreadsVariable = IConsoleManager::Get().FindConsoleVariable(TEXT("PTT.GenerationThreads"));
+	if (GenerationThreadsVariable)
+	{
+		GenerationThreadsVariable->OnChangedDelegate().Remove(GenerationThreadsChangedHandle);
+	}
+	GenerationThreadsChangedHandle.Reset();
+
+	//Stops the threads and releases any worker still waiting for a time slice.
+	delete Scheduler;
+	Scheduler = nullptr;
+}
+
+/**
+ * Resizes the scheduler's thread pool when PTT.GenerationThreads changes.
+ *
+ * @param Variable - The changed console variable.
+ */
+void FProcedualTerrainToolModule::OnGenerationThreadsChanged(IConsoleVariable* Variable)
+{
+	if (Scheduler)
+	{
+		Scheduler->SetThreadCount(Variable->GetInt());
+	}
 }
 
 #undef LOCTEXT_NAMESPACE
 
-IMPLEMENT_MODULE(FProcedualTerrainToolModule, ProcedualTerrainToolEditorMode)
\ No newline at end of file
+IMPLEMENT_MODULE(FProcedualTerrainToolModule, ProcedualTerrainToolEditorMode)
@@ -157,6 +157,36 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShapeMergeResult
 	//The number of old vertices lost during the merge.
 	UPROPERTY()
 	int Shrinkage = 0;
+
+	//The number of vertices of the original shape before the merged face that were inspected, even if the merge failed.
+	UPROPERTY()
+	int ReachBefore = 0;
+
+	//The number of vertices of the original shape after the merged face that were inspected, even if the merge failed.
+	UPROPERTY()
+	int ReachAfter = 0;
+
+	/**
+	 * Extends the reach of this merge by the vertices of the original shape that were inspected around the merged tile after it, such as by a lookahead.
+	 *
+	 * @param FaceIndex - The index of the face of the original shape that was merged at.
+	 * @param NumberOfVertices - The number of vertices of the original shape.
+	 * @param InspectedBefore - How many vertices before the first merged vertex were inspected.
+	 * @param InspectedAfter - How many vertices after the last merged vertex were inspected.
+	 */
+	void ExtendReach(const int FaceIndex, const int NumberOfVertices, const int InspectedBefore, const int InspectedAfter)
+	{
+		if (NumberOfVertices == 0)
+		{
+			return;
+		}
+
+		//The merge changes the vertices from the first merged vertex, where the new vertices start, to the last merged vertex, where the kept vertices start.
+		const int LastMergedVertex = UPTTMath::Mod(-Offset, NumberOfVertices);
+		const int FirstMergedVertex = UPTTMath::Mod(LastMergedVertex - Shrinkage, NumberOfVertices);
+		ReachBefore = FMath::Max(ReachBefore, UPTTMath::Mod(FaceIndex - FirstMergedVertex, NumberOfVertices) + InspectedBefore);
+		ReachAfter = FMath::Max(ReachAfter, UPTTMath::Mod(LastMergedVertex - FaceIndex, NumberOfVertices) + InspectedAfter);
+	}
 };
 
 /**
@@ -211,6 +241,51 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShape
 		return Vertices.Num();
 	}
 
+	/**
+	 * Gets the smallest number of faces this shape can be rotated by and still have the same sequence of types, lengths, and angles.
+	 *
+	 * @return The rotational period of this shape. Equal to Num() if this shape has no rotational symmetry.
+	 */
+	int GetRotationalPeriod() const
+	{
+		for (int Period = 1; Period < Num(); Period++)
+		{
+			if (Num() % Period != 0)
+			{
+				continue;
+			}
+
+			bool bSymmetric = true;
+			for (int VertexIndex = 0; VertexIndex < Num() && bSymmetric; VertexIndex++)
+			{
+				const FTerrainVertex& Vertex = Vertices[VertexIndex];
+				const FTerrainVertex& RotatedVertex = Vertices[(VertexIndex + Period) % Num()];
+				bSymmetric = Vertex.Type == RotatedVertex.Type && FMath::IsNearlyEqual(Vertex.Length, RotatedVertex.Length, KINDA_SMALL_NUMBER) && FMath::IsNearlyEqual(Vertex.Angle, RotatedVertex.Angle, KINDA_SMALL_NUMBER);
+			}
+
+			if (bSymmetric)
+			{
+				return Period;
+			}
+		}
+		return Num();
+	}
+
+	/**
+	 * Gets the area enclosed by this shape.
+	 *
+	 * @return The area enclosed by this shape.
+	 */
+	double GetArea() const
+	{
+		double DoubleArea = 0;
+		for (int VertexIndex = 0; VertexIndex < Num(); VertexIndex++)
+		{
+			DoubleArea += Vertices[VertexIndex].Location ^ Vertices[(VertexIndex + 1) % Num()].Location;
+		}
+		return abs(DoubleArea) / 2;
+	}
+
 	/**
 	 * Determines whether this shape can merge with another.
 	 *
@@ -219,8 +294,28 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShape
 	 * @param FaceIndex - The index of the face on this the other shape to start the merge at.
 	 * @return Whether or not this shape can be merged with the other shape.
 	 */
-	bool MergeShape(const int FaceIndex, const FTerrainShape Other, const int OtherFaceIndex) const
+	bool MergeShape(const int FaceIndex, const FTerrainShape& Other, const int OtherFaceIndex) const
 	{
+		int ReachBefore = 0;
+		int ReachAfter = 0;
+		return MergeShape(FaceIndex, Other, OtherFaceIndex, ReachBefore, ReachAfter);
+	}
+
+	/**
+	 * Determines whether this shape can merge with another, and how far along this shape it looked to find out.
+	 *
+	 * @param FaceIndex - The index of the face on this shape to start the merge at.
+	 * @param Other - The other shape to query.
+	 * @param FaceIndex - The index of the face on this the other shape to start the merge at.
+	 * @param ReachBefore - The number of vertices of this shape before the merged face that were inspected, even if the merge failed.
+	 * @param ReachAfter - The number of vertices of this shape after the merged face that were inspected, even if the merge failed.
+	 * @return Whether or not this shape can be merged with the other shape.
+	 */
+	bool MergeShape(const int FaceIndex, const FTerrainShape& Other, const int OtherFaceIndex, int& ReachBefore, int& ReachAfter) const
+	{
+		ReachBefore = 0;
+		ReachAfter = 0;
+
 		//Account for empty shapes.
 		if (Vertices.IsEmpty() && !Other.Vertices.IsEmpty())
 		{
@@ -246,10 +341,15 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShape
 			//Reset indices
 			int SearchIndex = UPTTMath::Mod(FaceIndex - bSearchingForVertex1, Num());
 			int OtherSearchIndex = UPTTMath::Mod(OtherFaceIndex + bSearchingForVertex1, Other.Num());
+			int SearchSteps = 0;
 
 			//Search all of shapes sockets to detect if connection is possible
 			do
 			{
+				//Record how far along this shape the merge has looked.
+				int& Reach = bSearchingForVertex1 ? ReachBefore : ReachAfter;
+				Reach = FMath::Max(Reach, FMath::Min(SearchSteps + 1, Num()));
+
 				//Test socket connectivity
 				switch (FTerrainVertex::CanVerticesConnect(Vertices[SearchIndex], Vertices[UPTTMath::Mod(SearchIndex + 1, Num())], Other.Vertices[UPTTMath::Mod(OtherSearchIndex + 1, Other.Num())], Other.Vertices[OtherSearchIndex]))
 				{
@@ -294,6 +394,7 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShape
 				//Iterate Indices
 				SearchIndex = UPTTMath::Mod(SearchIndex + (!bSearchingForVertex1 ? 1 : -1), Num());
 				OtherSearchIndex = UPTTMath::Mod(OtherSearchIndex + (bSearchingForVertex1 ? 1 : -1), Other.Num());
+				SearchSteps++;
 
 			} while (SearchIndex != FaceIndex);
 			ensureMsgf(false, TEXT("Shape indices mismatch"));
@@ -317,7 +418,7 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShape
 	 * @param bCalculateTransform -  Whether or not to calculate the merge transform and adjust vertex locations.
 	 * @return Whether or not this shape can be merged with the other shape.
 	 */
-	bool MergeShape(FTerrainShape& MergedShape, FTerrainShapeMergeResult& MergeResult, int FaceIndex, FTerrainShape Other, int OtherFaceIndex, bool bCalculateTransform = true) const
+	bool MergeShape(FTerrainShape& MergedShape, FTerrainShapeMergeResult& MergeResult, int FaceIndex, const FTerrainShape& Other, int OtherFaceIndex, bool bCalculateTransform = true) const
 	{
 		MergeResult = FTerrainShapeMergeResult();
 
@@ -350,10 +451,15 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShape
 			//Reset indices
 			int SearchIndex = UPTTMath::Mod(FaceIndex - bSearchingForVertex1, Num());
 			int OtherSearchIndex = UPTTMath::Mod(OtherFaceIndex + bSearchingForVertex1, Other.Num());
+			int SearchSteps = 0;
 
 			//Search all of shapes sockets to detect if connection is possible
 			do
 			{
+				//Record how far along this shape the merge has looked.
+				int& Reach = bSearchingForVertex1 ? MergeResult.ReachBefore : MergeResult.ReachAfter;
+				Reach = FMath::Max(Reach, FMath::Min(SearchSteps + 1, Num()));
+
 				//Test socket connectivity
 				switch (FTerrainVertex::CanVerticesConnect(Vertices[SearchIndex], Vertices[UPTTMath::Mod(SearchIndex + 1, Num())], Other.Vertices[UPTTMath::Mod(OtherSearchIndex - 1, Other.Num())], Other.Vertices[OtherSearchIndex]))
 				{
@@ -404,6 +510,7 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShape
 				//Iterate Indices
 				SearchIndex = UPTTMath::Mod(SearchIndex + (!bSearchingForVertex1 ? 1 : -1), Num());
 				OtherSearchIndex = UPTTMath::Mod(OtherSearchIndex + (bSearchingForVertex1 ? 1 : -1), Other.Num());
+				SearchSteps++;
 
 			} while (SearchIndex != FaceIndex);
 			ensureMsgf(false, TEXT("Shape indices mismatch"));
@@ -477,4 +584,7 @@ struct PROCEDUALTERRAINTOOL_API FTerrainShape
 	{
 		return Vertices == OtherShape.Vertices;
 	}
-};
\ No newline at end of file
+};
+
+//An immutable, reference counted copy of a terrain shape that can be shared between threads.
+typedef TSharedPtr<const FTerrainShape, ESPMode::ThreadSafe> FTerrainShapeSnapshot;
@@ -5,6 +5,9 @@
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
 
+class FTerrainGenerationScheduler;
+class IConsoleVariable;
+
 /**
  * This is the module definition for the editor mode. You can implement custom functionality
  * as your plugin module starts up and shuts down. See IModuleInterface for more extensibility options.
@@ -16,4 +19,17 @@ public:
 	/** IModuleInterface implementation */
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
+
+private:
+	/**
+	 * Resizes the scheduler's thread pool when PTT.GenerationThreads changes.
+	 *
+	 * @param Variable - The changed console variable.
+	 */
+	void OnGenerationThreadsChanged(IConsoleVariable* Variable);
+
+	//The scheduler shared by all terrain generators. Owned by this so that its threads never outlive the module.
+	FTerrainGenerationScheduler* Scheduler = nullptr;
+	//Registration of OnGenerationThreadsChanged with PTT.GenerationThreads.
+	FDelegateHandle GenerationThreadsChangedHandle;
 };
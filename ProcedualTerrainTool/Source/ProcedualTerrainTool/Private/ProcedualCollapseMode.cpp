@@ -4,6 +4,7 @@
 #include "ProcedualCollapseMode.h"
 
 #include "Components/ChildActorComponent.h"
+#include "Engine/Texture2D.h"
 #include "TerrainTileData.h"
 
 /* \/ ======================= \/ *\
@@ -27,17 +28,89 @@ UProcedualCollapseMode::UProcedualCollapseMode()
  * Gets the next super position to collapse on the given shape.
  *
  * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
- * @param CurrentShape - The current shape of the terrain.
- * @param SuperPositions - The current superposition states of the terrain.
- * @param SpawnableTiles - The tiles that can be spawned.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
  * @return Whether or not another collapse is needed.
  */
-bool UProcedualCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FTerrainShape CurrentShape, TArray<TArray<TArray<bool>>> SuperPositions, TArray<FTerrainTileSpawnData> SpawnableTiles, FRandomStream& RandomStream)
+bool FTerrainCollapseModeConfig::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const
 {
 	SuperPositionIndex = FIntVector();
+	ErrorLocation = FVector::ZeroVector;
+	return false;
+}
+
+/**
+ * Gets the next super positions to collapse on the given shape. Every superposition after the first must be independent of the ones before it. Only chooses one by default.
+ *
+ * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
+ * @param MaxBatchSize - The most superpositions to choose.
+ * @return Whether or not another collapse is needed after these.
+ */
+bool FTerrainCollapseModeConfig::GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const
+{
+	SuperPositionIndices.Reset();
+	return GetSuperPositionsToCollapse(SuperPositionIndices.AddDefaulted_GetRef(), ErrorLocation, Context, RandomStream);
+}
+
+/**
+ * Gets the spawnable tile this mode must place, if any.
+ *
+ * @return The index of the spawnable tile to place, or INDEX_NONE if any variant may be placed.
+ */
+int FTerrainCollapseModeConfig::GetRequiredTileIndex() const
+{
+	return INDEX_NONE;
+}
+
+/**
+ * Determines whether this mode may ever collapse a socket at a location. Includes everywhere by default.
+ *
+ * @param SocketLocation - The midpoint of the socket, in terrain space.
+ * @return Whether or not the location is inside of the bounds of this mode.
+ */
+bool FTerrainCollapseModeConfig::IsInBounds(const FVector2D SocketLocation) const
+{
+	return true;
+}
+
+/**
+ * Determines whether the worker should keep the active sockets sorted by GetSocketOrder for this mode. Off by default.
+ *
+ * @return Whether or not this mode chooses sockets from FTerrainCollapseContext::OrderedSockets.
+ */
+bool FTerrainCollapseModeConfig::UsesSocketOrder() const
+{
 	return false;
 }
 
+/**
+ * Gets where a socket is in the order sockets are collapsed in. Every socket is equal by default.
+ *
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param SocketIndex - The socket to order.
+ * @return The order of the socket. Sockets with lower orders are collapsed first.
+ */
+float FTerrainCollapseModeConfig::GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const
+{
+	return 0;
+}
+
+/**
+ * Copies the settings of this for the generation worker. Must be called on the game thread.
+ *
+ * @return An immutable copy of the settings of this.
+ */
+FTerrainCollapseModeConfigPtr UProcedualCollapseMode::CreateConfig() const
+{
+	TSharedRef<FTerrainCollapseModeConfig, ESPMode::ThreadSafe> Config = MakeShared<FTerrainCollapseModeConfig, ESPMode::ThreadSafe>();
+	Config->TerrainTransform = TerrainTransform;
+	return Config;
+}
+
 /**
  * Draws the bounds of what will be generated by this collapse mode.
  *
@@ -63,7 +136,10 @@ void UProcedualCollapseMode::DrawGenerationBounds() const
  */
 void AManualCollapseModeLocationMarker::PlaceTile()
 {
-	Cast<ATerrainGenerator>(Owner)->BeginGeneration();
+	if (IsValid(Owner) && IsValid(ConnectedMode))
+	{
+		Cast<ATerrainGenerator>(Owner)->PlaceTile(GetActorLocation(), ConnectedMode->TileIndex);
+	}
 }
 
 /**
@@ -126,42 +202,58 @@ UManualCollapseMode::UManualCollapseMode()
 	}
 }
 
+/**
+ * Copies the settings of this for the generation worker. Will collapse at the location of the CollapseLocationMarker.
+ *
+ * @return An immutable copy of the settings of this.
+ */
+FTerrainCollapseModeConfigPtr UManualCollapseMode::CreateConfig() const
+{
+	TSharedRef<FManualCollapseModeConfig, ESPMode::ThreadSafe> Config = MakeShared<FManualCollapseModeConfig, ESPMode::ThreadSafe>();
+	Config->TerrainTransform = TerrainTransform;
+	Config->bHasCollapseLocation = IsValid(CollapseLocationMarker);
+	Config->CollapseLocation = Config->bHasCollapseLocation ? CollapseLocationMarker->GetActorLocation() : FVector::ZeroVector;
+	Config->TileIndex = TileIndex;
+	return Config;
+}
+
+/**
+ * Gets the spawnable tile this mode must place.
+ *
+ * @return The index of the spawnable tile to place.
+ */
+int FManualCollapseModeConfig::GetRequiredTileIndex() const
+{
+	return TileIndex;
+}
+
 /**
  * Gets the next super position to collapse on the given shape. Will collapse at the location of the CollapseLocationMarker.
  *
  * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
- * @param CurrentShape - The current shape of the terrain.
- * @param SuperPositions - The current superposition states of the terrain.
- * @param SpawnableTiles - The tiles that can be spawned.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
  * @return Whether or not another collapse is needed.
  */
-bool UManualCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FTerrainShape CurrentShape, TArray<TArray<TArray<bool>>> SuperPositions, TArray<FTerrainTileSpawnData> SpawnableTiles, FRandomStream& RandomStream)
+bool FManualCollapseModeConfig::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const
 {
 	ErrorLocation = FVector::ZeroVector;
-	TileIndex = FMath::Clamp(TileIndex, 0, SpawnableTiles.Num() - 1);
+	const int ClampedTileIndex = FMath::Clamp(TileIndex, 0, Context.TileCatalog.SolverTileIndices.Num() - 1);
+	const int SolverTileIndex = Context.TileCatalog.SolverTileIndices.IsValidIndex(ClampedTileIndex) ? Context.TileCatalog.SolverTileIndices[ClampedTileIndex] : 0;
 
-	if (!SuperPositions.IsEmpty() && !CurrentShape.Vertices.IsEmpty() && IsValid(CollapseLocationMarker))
+	if (!Context.SuperPositions.IsEmpty() && !Context.Shape.Vertices.IsEmpty() && bHasCollapseLocation)
 	{
 		//Get socket closest to center
 		TMap<int, TArray<int>> PossibleCollapses = TMap<int, TArray<int>>();
-		int SocketIndex = 0;
-
-		float ClosestDistanceSquared = FVector2D::DistSquared((CurrentShape.Vertices[SocketIndex].Location + CurrentShape.Vertices[(SocketIndex + 1) % CurrentShape.Num()].Location) / 2, FVector2D(TerrainTransform.InverseTransformPosition(CollapseLocationMarker->GetActorLocation())));
-		for (int SearchIndex = 1; SearchIndex < CurrentShape.Num(); SearchIndex++)
-		{
-			float SeachDistanceSquared = FVector2D::DistSquared((CurrentShape.Vertices[SearchIndex].Location + CurrentShape.Vertices[(SearchIndex + 1) % CurrentShape.Num()].Location) / 2, FVector2D(TerrainTransform.InverseTransformPosition(CollapseLocationMarker->GetActorLocation())));
-			if (SeachDistanceSquared < ClosestDistanceSquared)
-			{
-				ClosestDistanceSquared = SeachDistanceSquared;
-				SocketIndex = SearchIndex;
-			}
-		}
+		float ClosestDistanceSquared;
+		const int SocketIndex = Context.FindClosestSocket(FVector2D(TerrainTransform.InverseTransformPosition(CollapseLocation)), ClosestDistanceSquared);
 
 		//Get possible collapses around selected socket
-		int ShapeIndex = TileIndex;
-		for (int FaceIndex = 0; FaceIndex < SuperPositions[SocketIndex][ShapeIndex].Num(); FaceIndex++)
+		int ShapeIndex = SolverTileIndex;
+		for (int FaceIndex = 0; FaceIndex < Context.SuperPositions[SocketIndex][ShapeIndex].Num(); FaceIndex++)
 		{
-			if (SuperPositions[SocketIndex][ShapeIndex][FaceIndex])
+			if (Context.SuperPositions[SocketIndex][ShapeIndex][FaceIndex])
 			{
 				if (!PossibleCollapses.Contains(ShapeIndex))
 				{
@@ -176,8 +268,8 @@ bool UManualCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPositionI
 		if (PossibleCollapses.IsEmpty())
 		{
 			UE_LOG(LogTerrainTool, Error, TEXT("Shapes do not tile, Consider adding another shape to fill the gap at the marked point or regenerating the terrain"), SocketIndex);
-			ErrorLocation = TerrainTransform.TransformPosition(FVector(((CurrentShape.Vertices[SocketIndex].Location + CurrentShape.Vertices[(SocketIndex + 1) % CurrentShape.Num()].Location) / 2), 0));
-			SuperPositionIndex = FIntVector(0, FMath::Clamp(TileIndex, 0, SpawnableTiles.Num()), 0);
+			ErrorLocation = TerrainTransform.TransformPosition(FVector(Context.GetSocketLocation(SocketIndex), 0));
+			SuperPositionIndex = FIntVector(0, SolverTileIndex, 0);
 			return false;
 		}
 
@@ -189,11 +281,11 @@ bool UManualCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPositionI
 		}
 
 		//Fail for memory loss
-		SuperPositionIndex = FIntVector(0, TileIndex, 0);
+		SuperPositionIndex = FIntVector(0, SolverTileIndex, 0);
 		return false;
 	}
 	//Fail for invalid shapes
-	SuperPositionIndex = FIntVector(0, TileIndex, 0);
+	SuperPositionIndex = FIntVector(0, SolverTileIndex, 0);
 	return false;
 }
 
@@ -211,97 +303,123 @@ bool UManualCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPositionI
  * Gets the next super position to collapse on the given shape. Will all superpositions within Radius.
  *
  * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
- * @param CurrentShape - The current shape of the terrain.
- * @param SuperPositions - The current superposition states of the terrain.
- * @param SpawnableTiles - The tiles that can be spawned.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
  * @return Whether or not another collapse is needed.
  */
-bool UCircularCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FTerrainShape CurrentShape, TArray<TArray<TArray<bool>>> SuperPositions, TArray<FTerrainTileSpawnData> SpawnableTiles, FRandomStream& RandomStream)
+bool FCircularCollapseModeConfig::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const
 {
-	if (!SuperPositions.IsEmpty() && !CurrentShape.Vertices.IsEmpty())
+	ErrorLocation = FVector::ZeroVector;
+	if (!Context.SuperPositions.IsEmpty() && !Context.Shape.Vertices.IsEmpty())
 	{
-		//Get socket closest to center
-		TMap<int, TArray<int>> PossibleCollapses = TMap<int, TArray<int>>();
-		int SocketIndex = 0;
-
-		float ClosestDistanceSquared = ((CurrentShape.Vertices[SocketIndex].Location + CurrentShape.Vertices[(SocketIndex + 1) % CurrentShape.Num()].Location) / 2).SquaredLength();
-		for (int SearchIndex = 1; SearchIndex < CurrentShape.Num(); SearchIndex++)
+		//Every socket outside of Radius is frozen, so the circle is full.
+		if (Context.OrderedSockets.IsEmpty())
 		{
-			float SeachDistanceSquared = ((CurrentShape.Vertices[SearchIndex].Location + CurrentShape.Vertices[(SearchIndex + 1) % CurrentShape.Num()].Location) / 2).SquaredLength();
-			if (SeachDistanceSquared < ClosestDistanceSquared)
-			{
-				ClosestDistanceSquared = SeachDistanceSquared;
-				SocketIndex = SearchIndex;
-			}
+			SuperPositionIndex = FIntVector(0, 0, 0);
+			return false;
 		}
 
-		//Get possible collapses around selected socket
-		for (int ShapeIndex = 0; ShapeIndex < SuperPositions[SocketIndex].Num(); ShapeIndex++)
-		{
-			for (int FaceIndex = 0; FaceIndex < SuperPositions[SocketIndex][ShapeIndex].Num(); FaceIndex++)
-			{
-				if (SuperPositions[SocketIndex][ShapeIndex][FaceIndex])
-				{
-					if (!PossibleCollapses.Contains(ShapeIndex))
-					{
-						PossibleCollapses.Emplace(ShapeIndex, TArray<int>());
-					}
-
-					PossibleCollapses.Find(ShapeIndex)->Emplace(FaceIndex);
-				}
-			}
-		}
+		//The first ordered socket is the closest to the center, or the most enclosed when growing compactly.
+		const int SocketIndex = Context.OrderedSockets[0];
 
 		//End if no valid collapses
-		if (PossibleCollapses.IsEmpty())
+		const FTerrainSocketCandidates& Candidates = Context.SocketCandidates[SocketIndex];
+		if (Candidates.IsEmpty())
 		{
-			UE_LOG(LogTerrainTool, Error, TEXT("Shapes do not tile, Consider adding another shape to fill the gap at the marked point or regenerating the terrain"), SocketIndex);
-			ErrorLocation = TerrainTransform.TransformPosition(FVector(((CurrentShape.Vertices[SocketIndex].Location + CurrentShape.Vertices[(SocketIndex + 1) % CurrentShape.Num()].Location) / 2), 0));
+			UE_LOG(LogTerrainTool, Error, TEXT("Shapes do not tile, Consider adding another shape to fill the gap at the marked point or regenerating the terrain"));
+			ErrorLocation = TerrainTransform.TransformPosition(FVector(Context.GetSocketLocation(SocketIndex), 0));
 			SuperPositionIndex = FIntVector(0, 0, 0);
 			return false;
 		}
 
-		//Get shape index weighted
-		TArray<int> Keys;
-		PossibleCollapses.GenerateKeyArray(Keys);
-		TArray<float> Weights = TArray<float>();
-		float WeightSum = 0;
-		for (int EachKey : Keys)
-		{
-			float LastWeight = 0;
-			if (Weights.IsValidIndex(Weights.Num() - 1))
-			{
-				LastWeight = Weights[Weights.Num() - 1];
-			}
-			WeightSum += SpawnableTiles[EachKey].SpawnWeight;
-			Weights.Emplace(SpawnableTiles[EachKey].SpawnWeight + LastWeight);
-		}
+		//Collapse superposition chosen by weight
+		const FIntPoint Candidate = Candidates.Sample(RandomStream);
+		SuperPositionIndex = FIntVector(SocketIndex, Candidate.X, Candidate.Y);
+		return true;
+	}
+	//Fail for invalid shapes
+	SuperPositionIndex = FIntVector(0, RandomStream.RandHelper(Context.TileCatalog.Num()), 0);
+	return Context.Shape.Vertices.IsEmpty() && Context.TileCatalog.Num() > 0 && !Context.SuperPositions.IsEmpty() && !Context.SuperPositions[0].IsEmpty() && !Context.SuperPositions[0][0].IsEmpty();
+}
 
-		int ShapeIndex = 0;
-		float RandomSelector = RandomStream.FRandRange(0.f, WeightSum);
-		for (int KeyIndex = 0; KeyIndex < Keys.Num(); KeyIndex++)
-		{
-			if (Weights[KeyIndex] >= RandomSelector)
-			{
-				ShapeIndex = Keys[KeyIndex];
-				break;
-			}
-		}
+/**
+ * Gets the next super positions to collapse on the given shape. Chooses the closest independent sockets to the center within Radius.
+ *
+ * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
+ * @param MaxBatchSize - The most superpositions to choose.
+ * @return Whether or not another collapse is needed after these.
+ */
+bool FCircularCollapseModeConfig::GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const
+{
+	SuperPositionIndices.Reset();
+	const bool bNeedsMoreCollapses = GetSuperPositionsToCollapse(SuperPositionIndices.AddDefaulted_GetRef(), ErrorLocation, Context, RandomStream);
+	if (!bNeedsMoreCollapses || Context.Shape.Vertices.IsEmpty())
+	{
+		return bNeedsMoreCollapses;
+	}
 
-		//Collapse superposition
-		if (ensure(!PossibleCollapses.IsEmpty() && !PossibleCollapses.FindRef(ShapeIndex).IsEmpty()))
+	//Add the next closest sockets that cannot interfere with the ones already chosen. Only sockets inside of Radius are ordered.
+	for (int OrderIndex = 1; OrderIndex < Context.OrderedSockets.Num() && SuperPositionIndices.Num() < MaxBatchSize; OrderIndex++)
+	{
+		const int SearchIndex = Context.OrderedSockets[OrderIndex];
+		if (!Context.SocketCandidates[SearchIndex].IsEmpty() && Context.IsIndependentOf(SearchIndex, SuperPositionIndices))
 		{
-			SuperPositionIndex = FIntVector(SocketIndex, ShapeIndex, PossibleCollapses.FindRef(ShapeIndex)[RandomStream.RandHelper(PossibleCollapses.FindRef(ShapeIndex).Num())]);
-			return ClosestDistanceSquared < Radius * Radius;
+			const FIntPoint Candidate = Context.SocketCandidates[SearchIndex].Sample(RandomStream);
+			SuperPositionIndices.Emplace(SearchIndex, Candidate.X, Candidate.Y);
 		}
-
-		//Fail for memory loss
-		SuperPositionIndex = FIntVector(0, 0, 0);
-		return false;
 	}
-	//Fail for invalid shapes
-	SuperPositionIndex = FIntVector(0, RandomStream.RandHelper(SpawnableTiles.Num()), 0);
-	return CurrentShape.Vertices.IsEmpty() && !SpawnableTiles.IsEmpty() && !SuperPositions.IsEmpty() && !SuperPositions[0].IsEmpty() && !SuperPositions[0][0].IsEmpty();
+	return true;
+}
+
+/**
+ * Gets where a socket is in the order sockets are collapsed in. Mixes the distance to the center with how enclosed the socket is.
+ *
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param SocketIndex - The socket to order.
+ * @return The order of the socket. Sockets with lower orders are collapsed first.
+ */
+float FCircularCollapseModeConfig::GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const
+{
+	return Context.GetSocketLocation(SocketIndex).SquaredLength() / FMath::Max(Radius * Radius, KINDA_SMALL_NUMBER) - CompactGrowthWeight * Context.GetSocketConcavity(SocketIndex);
+}
+
+/**
+ * Determines whether a location is within Radius.
+ *
+ * @param SocketLocation - The midpoint of the socket, in terrain space.
+ * @return Whether or not the location is inside of the circle.
+ */
+bool FCircularCollapseModeConfig::IsInBounds(const FVector2D SocketLocation) const
+{
+	return SocketLocation.SquaredLength() < Radius * Radius;
+}
+
+/**
+ * Keeps the active sockets sorted by distance to the center and how enclosed they are.
+ *
+ * @return True.
+ */
+bool FCircularCollapseModeConfig::UsesSocketOrder() const
+{
+	return true;
+}
+
+/**
+ * Copies the settings of this for the generation worker.
+ *
+ * @return An immutable copy of the settings of this.
+ */
+FTerrainCollapseModeConfigPtr UCircularCollapseMode::CreateConfig() const
+{
+	TSharedRef<FCircularCollapseModeConfig, ESPMode::ThreadSafe> Config = MakeShared<FCircularCollapseModeConfig, ESPMode::ThreadSafe>();
+	Config->TerrainTransform = TerrainTransform;
+	Config->Radius = Radius;
+	Config->CompactGrowthWeight = CompactGrowthWeight;
+	return Config;
 }
 
 /**
@@ -329,97 +447,630 @@ bool UCircularCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPositio
  * Gets the next super position to collapse on the given shape. Will all superpositions within a box with the given extent.
  *
  * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
- * @param CurrentShape - The current shape of the terrain.
- * @param SuperPositions - The current superposition states of the terrain.
- * @param SpawnableTiles - The tiles that can be spawned.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
  * @return Whether or not another collapse is needed.
  */
-bool URectangularCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FTerrainShape CurrentShape, TArray<TArray<TArray<bool>>> SuperPositions, TArray<FTerrainTileSpawnData> SpawnableTiles, FRandomStream& RandomStream)
+bool FRectangularCollapseModeConfig::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const
 {
-	if (!SuperPositions.IsEmpty() && !CurrentShape.Vertices.IsEmpty())
+	ErrorLocation = FVector::ZeroVector;
+	if (!Context.SuperPositions.IsEmpty() && !Context.Shape.Vertices.IsEmpty())
 	{
-		//Find left most point in extent.
-		TMap<int, TArray<int>> PossibleCollapses = TMap<int, TArray<int>>();
-		int SocketIndex = 0;
-		float LeastXValue = MAX_FLT;
-		bool bValidSocketFound = false;
+		//Every socket outside of the box is frozen, so the box is full.
+		if (Context.OrderedSockets.IsEmpty())
+		{
+			SuperPositionIndex = FIntVector(0, 0, 0);
+			return false;
+		}
 
-		for (int SearchIndex = 0; SearchIndex < CurrentShape.Num(); SearchIndex++)
+		//The first ordered socket is the left most, or the most enclosed when growing compactly.
+		const int SocketIndex = Context.OrderedSockets[0];
+
+		//End if no valid collapses
+		const FTerrainSocketCandidates& Candidates = Context.SocketCandidates[SocketIndex];
+		if (Candidates.IsEmpty())
 		{
-			FVector2D SocketLocation = ((CurrentShape.Vertices[SearchIndex].Location + CurrentShape.Vertices[(SearchIndex + 1) % CurrentShape.Num()].Location) / 2).GetAbs();
-			if (SocketLocation.X < LeastXValue && ((SocketLocation.X < abs(Extent.X)) && (SocketLocation.Y < abs(Extent.Y))))
-			{
-				bValidSocketFound = true;
-				LeastXValue = SocketLocation.X;
-				SocketIndex = SearchIndex;
-			}
+			UE_LOG(LogTerrainTool, Error, TEXT("Shapes do not tile, Consider adding another shape to fill the gap at the marked point or regenerating the terrain"));
+			ErrorLocation = TerrainTransform.TransformPosition(FVector(Context.GetSocketLocation(SocketIndex), 0));
+			SuperPositionIndex = FIntVector(0, 0, 0);
+			return false;
 		}
 
-		//Get Possible collapses
-		for (int ShapeIndex = 0; ShapeIndex < SuperPositions[SocketIndex].Num(); ShapeIndex++)
+		//Collapse superposition chosen by weight
+		const FIntPoint Candidate = Candidates.Sample(RandomStream);
+		SuperPositionIndex = FIntVector(SocketIndex, Candidate.X, Candidate.Y);
+		return true;
+	}
+
+	SuperPositionIndex = FIntVector(0, RandomStream.RandHelper(Context.TileCatalog.Num()), 0);
+	return Context.Shape.Vertices.IsEmpty() && Context.TileCatalog.Num() > 0 && !Context.SuperPositions.IsEmpty() && !Context.SuperPositions[0].IsEmpty() && !Context.SuperPositions[0][0].IsEmpty();
+}
+
+/**
+ * Gets the next super positions to collapse on the given shape. Chooses the left most independent sockets within a box with the given extent.
+ *
+ * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
+ * @param MaxBatchSize - The most superpositions to choose.
+ * @return Whether or not another collapse is needed after these.
+ */
+bool FRectangularCollapseModeConfig::GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const
+{
+	SuperPositionIndices.Reset();
+	const bool bNeedsMoreCollapses = GetSuperPositionsToCollapse(SuperPositionIndices.AddDefaulted_GetRef(), ErrorLocation, Context, RandomStream);
+	if (!bNeedsMoreCollapses || Context.Shape.Vertices.IsEmpty())
+	{
+		return bNeedsMoreCollapses;
+	}
+
+	//Add the next left most sockets that cannot interfere with the ones already chosen. Only sockets inside of the box are ordered.
+	for (int OrderIndex = 1; OrderIndex < Context.OrderedSockets.Num() && SuperPositionIndices.Num() < MaxBatchSize; OrderIndex++)
+	{
+		const int SearchIndex = Context.OrderedSockets[OrderIndex];
+		if (!Context.SocketCandidates[SearchIndex].IsEmpty() && Context.IsIndependentOf(SearchIndex, SuperPositionIndices))
 		{
-			for (int FaceIndex = 0; FaceIndex < SuperPositions[SocketIndex][ShapeIndex].Num(); FaceIndex++)
-			{
-				if (SuperPositions[SocketIndex][ShapeIndex][FaceIndex])
-				{
-					if (!PossibleCollapses.Contains(ShapeIndex))
-					{
-						PossibleCollapses.Emplace(ShapeIndex, TArray<int>());
-					}
+			const FIntPoint Candidate = Context.SocketCandidates[SearchIndex].Sample(RandomStream);
+			SuperPositionIndices.Emplace(SearchIndex, Candidate.X, Candidate.Y);
+		}
+	}
+	return true;
+}
 
-					PossibleCollapses.Find(ShapeIndex)->Emplace(FaceIndex);
-				}
-			}
+/**
+ * Gets where a socket is in the order sockets are collapsed in. Mixes the distance along the box with how enclosed the socket is.
+ *
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param SocketIndex - The socket to order.
+ * @return The order of the socket. Sockets with lower orders are collapsed first.
+ */
+float FRectangularCollapseModeConfig::GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const
+{
+	return abs(Context.GetSocketLocation(SocketIndex).X) / FMath::Max(abs(Extent.X), KINDA_SMALL_NUMBER) - CompactGrowthWeight * Context.GetSocketConcavity(SocketIndex);
+}
+
+/**
+ * Determines whether a location is within the box with the given extent.
+ *
+ * @param SocketLocation - The midpoint of the socket, in terrain space.
+ * @return Whether or not the location is inside of the box.
+ */
+bool FRectangularCollapseModeConfig::IsInBounds(const FVector2D SocketLocation) const
+{
+	return abs(SocketLocation.X) < abs(Extent.X) && abs(SocketLocation.Y) < abs(Extent.Y);
+}
+
+/**
+ * Keeps the active sockets sorted by distance along the box and how enclosed they are.
+ *
+ * @return True.
+ */
+bool FRectangularCollapseModeConfig::UsesSocketOrder() const
+{
+	return true;
+}
+
+/**
+ * Copies the settings of this for the generation worker.
+ *
+ * @return An immutable copy of the settings of this.
+ */
+FTerrainCollapseModeConfigPtr URectangularCollapseMode::CreateConfig() const
+{
+	TSharedRef<FRectangularCollapseModeConfig, ESPMode::ThreadSafe> Config = MakeShared<FRectangularCollapseModeConfig, ESPMode::ThreadSafe>();
+	Config->TerrainTransform = TerrainTransform;
+	Config->Extent = Extent;
+	Config->CompactGrowthWeight = CompactGrowthWeight;
+	return Config;
+}
+
+/**
+ * Draws the bounds of what will be generated by this collapse mode.
+ *
+ * @param TerrainTransform - The transform to apply to the bounds.
+ */
+void URectangularCollapseMode::DrawGenerationBounds() const
+{
+	FlushPersistentDebugLines(GetWorld());
+	DrawDebugBox(GetWorld(), TerrainTransform.GetTranslation(), FVector(Extent, 0), TerrainTransform.GetRotation(), FColor::Magenta, true, 10, 0U, 150);
+}
+
+/* /\ ========================= /\ *\
+|  /\ URectangularCollapseMode  /\  |
+\* /\ ========================= /\ */
+
+
+
+/* \/ =================== \/ *\
+|  \/ USweepCollapseMode  \/  |
+\* \/ =================== \/ */
+
+/**
+ * Gets the row of the sweep a location is in. Rows are counted up from the bottom of the box.
+ *
+ * @param SocketLocation - The location to check, in terrain space.
+ * @return The row the location is in.
+ */
+int FSweepCollapseModeConfig::GetRow(const FVector2D SocketLocation) const
+{
+	return FMath::FloorToInt((SocketLocation.Y + abs(Extent.Y)) / FMath::Max(RowHeight, 1.f));
+}
+
+/**
+ * Gets the next super position to collapse on the given shape. Will collapse the first socket in sweep order.
+ *
+ * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
+ * @return Whether or not another collapse is needed.
+ */
+bool FSweepCollapseModeConfig::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const
+{
+	ErrorLocation = FVector::ZeroVector;
+	if (!Context.SuperPositions.IsEmpty() && !Context.Shape.Vertices.IsEmpty())
+	{
+		//Every socket outside of the box is frozen, so the box is full.
+		if (Context.OrderedSockets.IsEmpty())
+		{
+			SuperPositionIndex = FIntVector(0, 0, 0);
+			return false;
 		}
 
 		//End if no valid collapses
-		if (PossibleCollapses.IsEmpty())
+		const int SocketIndex = Context.OrderedSockets[0];
+		const FTerrainSocketCandidates& Candidates = Context.SocketCandidates[SocketIndex];
+		if (Candidates.IsEmpty())
 		{
-			UE_LOG(LogTerrainTool, Error, TEXT("Shapes do not tile, Consider adding another shape to fill the gap at the marked point or regenerating the terrain"), SocketIndex);
-			ErrorLocation = TerrainTransform.TransformPosition(FVector(((CurrentShape.Vertices[SocketIndex].Location + CurrentShape.Vertices[(SocketIndex + 1) % CurrentShape.Num()].Location) / 2), 0));
+			UE_LOG(LogTerrainTool, Error, TEXT("Shapes do not tile, Consider adding another shape to fill the gap at the marked point or regenerating the terrain"));
+			ErrorLocation = TerrainTransform.TransformPosition(FVector(Context.GetSocketLocation(SocketIndex), 0));
 			SuperPositionIndex = FIntVector(0, 0, 0);
 			return false;
 		}
 
-		//Get shape index weighted
-		TArray<int> Keys;
-		PossibleCollapses.GenerateKeyArray(Keys);
-		TArray<float> Weights = TArray<float>();
-		float WeightSum = 0;
-		for (int EachKey : Keys)
+		//Collapse superposition chosen by weight
+		const FIntPoint Candidate = Candidates.Sample(RandomStream);
+		SuperPositionIndex = FIntVector(SocketIndex, Candidate.X, Candidate.Y);
+		return true;
+	}
+
+	SuperPositionIndex = FIntVector(0, RandomStream.RandHelper(Context.TileCatalog.Num()), 0);
+	return Context.Shape.Vertices.IsEmpty() && Context.TileCatalog.Num() > 0 && !Context.SuperPositions.IsEmpty() && !Context.SuperPositions[0].IsEmpty() && !Context.SuperPositions[0][0].IsEmpty();
+}
+
+/**
+ * Gets the next super positions to collapse on the given shape. Chooses the first independent sockets in sweep order on the lowest unfinished rows.
+ *
+ * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
+ * @param MaxBatchSize - The most superpositions to choose.
+ * @return Whether or not another collapse is needed after these.
+ */
+bool FSweepCollapseModeConfig::GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const
+{
+	SuperPositionIndices.Reset();
+	const bool bNeedsMoreCollapses = GetSuperPositionsToCollapse(SuperPositionIndices.AddDefaulted_GetRef(), ErrorLocation, Context, RandomStream);
+	if (!bNeedsMoreCollapses || Context.Shape.Vertices.IsEmpty())
+	{
+		return bNeedsMoreCollapses;
+	}
+
+	//Add the next sockets along the sweep, without running ahead of the row after the one being filled.
+	const int LastRow = GetRow(Context.GetSocketLocation(Context.OrderedSockets[0])) + 1;
+	for (int OrderIndex = 1; OrderIndex < Context.OrderedSockets.Num() && SuperPositionIndices.Num() < MaxBatchSize; OrderIndex++)
+	{
+		const int SearchIndex = Context.OrderedSockets[OrderIndex];
+		if (GetRow(Context.GetSocketLocation(SearchIndex)) > LastRow)
+		{
+			break;
+		}
+
+		if (!Context.SocketCandidates[SearchIndex].IsEmpty() && Context.IsIndependentOf(SearchIndex, SuperPositionIndices))
+		{
+			const FIntPoint Candidate = Context.SocketCandidates[SearchIndex].Sample(RandomStream);
+			SuperPositionIndices.Emplace(SearchIndex, Candidate.X, Candidate.Y);
+		}
+	}
+	return true;
+}
+
+/**
+ * Determines whether a location is within the box with the given extent.
+ *
+ * @param SocketLocation - The midpoint of the socket, in terrain space.
+ * @return Whether or not the location is inside of the box.
+ */
+bool FSweepCollapseModeConfig::IsInBounds(const FVector2D SocketLocation) const
+{
+	return abs(SocketLocation.X) < abs(Extent.X) && abs(SocketLocation.Y) < abs(Extent.Y);
+}
+
+/**
+ * Keeps the active sockets sorted in sweep order.
+ *
+ * @return True.
+ */
+bool FSweepCollapseModeConfig::UsesSocketOrder() const
+{
+	return true;
+}
+
+/**
+ * Gets where a socket is in sweep order. Rows are filled from the bottom of the box up, and each row from left to right.
+ *
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param SocketIndex - The socket to order.
+ * @return The row of the socket plus how far along the row it is, as a fraction.
+ */
+float FSweepCollapseModeConfig::GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const
+{
+	const FVector2D SocketLocation = Context.GetSocketLocation(SocketIndex);
+	return GetRow(SocketLocation) + FMath::Clamp((SocketLocation.X + abs(Extent.X)) / (2 * abs(Extent.X) + 1), 0.f, 0.99f);
+}
+
+/**
+ * Copies the settings of this for the generation worker.
+ *
+ * @return An immutable copy of the settings of this.
+ */
+FTerrainCollapseModeConfigPtr USweepCollapseMode::CreateConfig() const
+{
+	TSharedRef<FSweepCollapseModeConfig, ESPMode::ThreadSafe> Config = MakeShared<FSweepCollapseModeConfig, ESPMode::ThreadSafe>();
+	Config->TerrainTransform = TerrainTransform;
+	Config->Extent = Extent;
+	Config->RowHeight = RowHeight;
+	return Config;
+}
+
+/**
+ * Draws the bounds of what will be generated by this collapse mode.
+ *
+ * @param TerrainTransform - The transform to apply to the bounds.
+ */
+void USweepCollapseMode::DrawGenerationBounds() const
+{
+	FlushPersistentDebugLines(GetWorld());
+	DrawDebugBox(GetWorld(), TerrainTransform.GetTranslation(), FVector(Extent, 0), TerrainTransform.GetRotation(), FColor::Magenta, true, 10, 0U, 150);
+}
+
+/* /\ =================== /\ *\
+|  /\ USweepCollapseMode  /\  |
+\* /\ =================== /\ */
+
+
+
+/* \/ =================== \/ *\
+|  \/ FTerrainRegionGrid  \/  |
+\* \/ =================== \/ */
+
+/**
+ * Creates a grid covering the given bounds with no cells inside of the region.
+ *
+ * @param Bounds - The area to cover, in terrain space.
+ * @param GridCellSize - The width and height of each cell. Increased if the bounds would need more than MaxResolution cells along an axis.
+ */
+FTerrainRegionGrid::FTerrainRegionGrid(const FBox2D& Bounds, const float GridCellSize)
+{
+	if (!Bounds.bIsValid)
+	{
+		return;
+	}
+
+	const FVector2D Size = Bounds.GetSize();
+	Origin = Bounds.Min;
+	CellSize = FMath::Max3(FMath::Max(GridCellSize, 1.f), (float)Size.X / MaxResolution, (float)Size.Y / MaxResolution);
+	Resolution = FIntPoint(FMath::Max(FMath::CeilToInt(Size.X / CellSize), 1), FMath::Max(FMath::CeilToInt(Size.Y / CellSize), 1));
+	Cells.Init(false, Resolution.X * Resolution.Y);
+}
+
+/**
+ * Adds the inside of a polygon to the region. Self intersecting polygons use the even-odd rule.
+ *
+ * @param Points - The corners of the polygon, in terrain space.
+ */
+void FTerrainRegionGrid::AddPolygon(const TArray<FVector2D>& Points)
+{
+	if (Points.Num() < 3)
+	{
+		return;
+	}
+
+	//Fill between pairs of edge crossings along the center of each row of cells.
+	TArray<double> Crossings = TArray<double>();
+	for (int CellY = 0; CellY < Resolution.Y; CellY++)
+	{
+		const double RowY = Origin.Y + (CellY + 0.5) * CellSize;
+		Crossings.Reset();
+		for (int PointIndex = 0; PointIndex < Points.Num(); PointIndex++)
 		{
-			float LastWeight = 0;
-			if (Weights.IsValidIndex(Weights.Num() - 1))
+			const FVector2D& Start = Points[PointIndex];
+			const FVector2D& End = Points[(PointIndex + 1) % Points.Num()];
+			if ((Start.Y <= RowY) != (End.Y <= RowY))
 			{
-				LastWeight = Weights[Weights.Num() - 1];
+				Crossings.Emplace(Start.X + (RowY - Start.Y) / (End.Y - Start.Y) * (End.X - Start.X));
 			}
-			WeightSum += SpawnableTiles[EachKey].SpawnWeight;
-			Weights.Emplace(SpawnableTiles[EachKey].SpawnWeight + LastWeight);
 		}
+		Crossings.Sort();
 
-		int ShapeIndex = 0;
-		float RandomSelector = RandomStream.FRandRange(0.f, WeightSum);
-		for (int KeyIndex = 0; KeyIndex < Keys.Num(); KeyIndex++)
+		for (int CrossingIndex = 0; CrossingIndex + 1 < Crossings.Num(); CrossingIndex += 2)
 		{
-			if (Weights[KeyIndex] >= RandomSelector)
+			const int FirstCell = FMath::Max(FMath::CeilToInt((Crossings[CrossingIndex] - Origin.X) / CellSize - 0.5), 0);
+			const int LastCell = FMath::Min(FMath::FloorToInt((Crossings[CrossingIndex + 1] - Origin.X) / CellSize - 0.5), Resolution.X - 1);
+			if (FirstCell <= LastCell)
 			{
-				ShapeIndex = Keys[KeyIndex];
-				break;
+				Cells.SetRange(CellY * Resolution.X + FirstCell, LastCell - FirstCell + 1, true);
 			}
 		}
+	}
+}
 
-		//Collapse superposition
-		if (ensure(!PossibleCollapses.IsEmpty() && !PossibleCollapses.FindRef(ShapeIndex).IsEmpty()))
+/**
+ * Adds the pixels of a texture that are at least as bright as a threshold to the region. Only reads the red channel.
+ *
+ * @param Mask - The texture to read. Must have 8 bit grayscale or BGRA source data.
+ * @param MaskBounds - The area the texture covers, in terrain space. The first pixel is at the minimum corner.
+ * @param Threshold - The brightness from 0 to 1 a pixel needs to be inside of the region.
+ */
+void FTerrainRegionGrid::AddMask(UTexture2D* Mask, const FBox2D& MaskBounds, const float Threshold)
+{
+	const FVector2D MaskSize = MaskBounds.GetSize();
+	if (!IsValid(Mask) || !MaskBounds.bIsValid || MaskSize.X <= 0 || MaskSize.Y <= 0)
+	{
+		return;
+	}
+
+	int BytesPerPixel;
+	int RedOffset;
+	switch (Mask->Source.GetFormat())
+	{
+	case TSF_G8:
+		BytesPerPixel = 1;
+		RedOffset = 0;
+		break;
+
+	case TSF_BGRA8:
+		BytesPerPixel = 4;
+		RedOffset = 2;
+		break;
+
+	default:
+		UE_LOG(LogTerrainTool, Warning, TEXT("The mask %s must have 8 bit grayscale or BGRA source data to be used as a region"), *Mask->GetName());
+		return;
+	}
+
+	const int Width = Mask->Source.GetSizeX();
+	const int Height = Mask->Source.GetSizeY();
+	TArray64<uint8> MipData = TArray64<uint8>();
+	if (Width <= 0 || Height <= 0 || !Mask->Source.GetMipData(MipData, 0))
+	{
+		return;
+	}
+
+	const uint8 MinimumValue = (uint8)FMath::Clamp(FMath::CeilToInt(Threshold * 255), 0, 255);
+	for (int CellY = 0; CellY < Resolution.Y; CellY++)
+	{
+		for (int CellX = 0; CellX < Resolution.X; CellX++)
 		{
-			SuperPositionIndex = FIntVector(SocketIndex, ShapeIndex, PossibleCollapses.FindRef(ShapeIndex)[RandomStream.RandHelper(PossibleCollapses.FindRef(ShapeIndex).Num())]);
-			return bValidSocketFound;
+			//Sample the pixel under the center of the cell.
+			const FVector2D MaskLocation = (Origin + (FVector2D(CellX, CellY) + 0.5) * CellSize - MaskBounds.Min) / MaskSize;
+			if (MaskLocation.X < 0 || MaskLocation.Y < 0 || MaskLocation.X >= 1 || MaskLocation.Y >= 1)
+			{
+				continue;
+			}
+
+			const int PixelX = FMath::Min(FMath::FloorToInt(MaskLocation.X * Width), Width - 1);
+			const int PixelY = FMath::Min(FMath::FloorToInt(MaskLocation.Y * Height), Height - 1);
+			if (MipData[((int64)PixelY * Width + PixelX) * BytesPerPixel + RedOffset] >= MinimumValue)
+			{
+				Cells[CellY * Resolution.X + CellX] = true;
+			}
 		}
-		SuperPositionIndex = FIntVector(0, 0, 0);
-		return false;
 	}
+}
+
+/* /\ =================== /\ *\
+|  /\ FTerrainRegionGrid  /\  |
+\* /\ =================== /\ */
+
+
+
+/* \/ ==================== \/ *\
+|  \/ URegionCollapseMode  \/  |
+\* \/ ==================== \/ */
+
+/**
+ * Gets the next super position to collapse on the given shape. Will collapse the socket closest to the center within the region.
+ *
+ * @param SuperPositionIndex - Set to the indices of the super position to collapse next.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
+ * @return Whether or not another collapse is needed.
+ */
+bool FRegionCollapseModeConfig::GetSuperPositionsToCollapse(FIntVector& SuperPositionIndex, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream) const
+{
+	ErrorLocation = FVector::ZeroVector;
+	if (!Context.SuperPositions.IsEmpty() && !Context.Shape.Vertices.IsEmpty())
+	{
+		//Every socket outside of the region is frozen, so the region is full.
+		if (Context.OrderedSockets.IsEmpty())
+		{
+			SuperPositionIndex = FIntVector(0, 0, 0);
+			return false;
+		}
+
+		//End if no valid collapses
+		const int SocketIndex = Context.OrderedSockets[0];
+		const FTerrainSocketCandidates& Candidates = Context.SocketCandidates[SocketIndex];
+		if (Candidates.IsEmpty())
+		{
+			UE_LOG(LogTerrainTool, Error, TEXT("Shapes do not tile, Consider adding another shape to fill the gap at the marked point or regenerating the terrain"));
+			ErrorLocation = TerrainTransform.TransformPosition(FVector(Context.GetSocketLocation(SocketIndex), 0));
+			SuperPositionIndex = FIntVector(0, 0, 0);
+			return false;
+		}
+
+		//Collapse superposition chosen by weight
+		const FIntPoint Candidate = Candidates.Sample(RandomStream);
+		SuperPositionIndex = FIntVector(SocketIndex, Candidate.X, Candidate.Y);
+		return true;
+	}
+
+	SuperPositionIndex = FIntVector(0, RandomStream.RandHelper(Context.TileCatalog.Num()), 0);
+	return Context.Shape.Vertices.IsEmpty() && Context.TileCatalog.Num() > 0 && !Context.SuperPositions.IsEmpty() && !Context.SuperPositions[0].IsEmpty() && !Context.SuperPositions[0][0].IsEmpty();
+}
+
+/**
+ * Gets the next super positions to collapse on the given shape. Chooses the independent sockets closest to the center within the region.
+ *
+ * @param SuperPositionIndices - Set to the indices of the super positions to collapse next, in the order they should be collapsed.
+ * @param ErrorLocation - Set to the location of any error, in world space. Will be 0,0,0 if there are no errors.
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param RandomStream - The random stream used to choose.
+ * @param MaxBatchSize - The most superpositions to choose.
+ * @return Whether or not another collapse is needed after these.
+ */
+bool FRegionCollapseModeConfig::GetSuperPositionBatchToCollapse(TArray<FIntVector>& SuperPositionIndices, FVector& ErrorLocation, const FTerrainCollapseContext& Context, FRandomStream& RandomStream, const int MaxBatchSize) const
+{
+	SuperPositionIndices.Reset();
+	const bool bNeedsMoreCollapses = GetSuperPositionsToCollapse(SuperPositionIndices.AddDefaulted_GetRef(), ErrorLocation, Context, RandomStream);
+	if (!bNeedsMoreCollapses || Context.Shape.Vertices.IsEmpty())
+	{
+		return bNeedsMoreCollapses;
+	}
+
+	//Add the next closest sockets that cannot interfere with the ones already chosen. Only sockets inside of the region are ordered.
+	for (int OrderIndex = 1; OrderIndex < Context.OrderedSockets.Num() && SuperPositionIndices.Num() < MaxBatchSize; OrderIndex++)
+	{
+		const int SearchIndex = Context.OrderedSockets[OrderIndex];
+		if (!Context.SocketCandidates[SearchIndex].IsEmpty() && Context.IsIndependentOf(SearchIndex, SuperPositionIndices))
+		{
+			const FIntPoint Candidate = Context.SocketCandidates[SearchIndex].Sample(RandomStream);
+			SuperPositionIndices.Emplace(SearchIndex, Candidate.X, Candidate.Y);
+		}
+	}
+	return true;
+}
+
+/**
+ * Determines whether a location is inside of the region.
+ *
+ * @param SocketLocation - The midpoint of the socket, in terrain space.
+ * @return Whether or not the location is inside of the region.
+ */
+bool FRegionCollapseModeConfig::IsInBounds(const FVector2D SocketLocation) const
+{
+	return Region.IsValid() && Region->IsInside(SocketLocation);
+}
+
+/**
+ * Keeps the active sockets sorted by distance to the center.
+ *
+ * @return True.
+ */
+bool FRegionCollapseModeConfig::UsesSocketOrder() const
+{
+	return true;
+}
+
+/**
+ * Gets where a socket is in the order sockets are collapsed in.
+ *
+ * @param Context - A read-only view of the shape, superpositions and tiles of the terrain.
+ * @param SocketIndex - The socket to order.
+ * @return The squared distance from the center to the socket.
+ */
+float FRegionCollapseModeConfig::GetSocketOrder(const FTerrainCollapseContext& Context, const int SocketIndex) const
+{
+	return Context.GetSocketLocation(SocketIndex).SquaredLength();
+}
+
+/**
+ * Copies the settings of this for the generation worker. Rasterizes the region first if it has not been yet or the mask has changed since.
+ *
+ * @return An immutable copy of the settings of this.
+ */
+FTerrainCollapseModeConfigPtr URegionCollapseMode::CreateConfig() const
+{
+	//Reimporting or editing the mask changes its source without changing any property of this.
+	if (!RegionGrid.IsValid() || GetMaskSourceId() != RegionMaskSourceId)
+	{
+		RebuildRegion();
+	}
+
+	if (RegionGrid->Cells.IsEmpty())
+	{
+		UE_LOG(LogTerrainTool, Warning, TEXT("The region has no polygons or mask, so nothing will be generated"));
+	}
+
+	TSharedRef<FRegionCollapseModeConfig, ESPMode::ThreadSafe> Config = MakeShared<FRegionCollapseModeConfig, ESPMode::ThreadSafe>();
+	Config->TerrainTransform = TerrainTransform;
+	Config->Region = RegionGrid;
+	return Config;
+}
+
+#if WITH_EDITOR
+/**
+ * Rasterizes the region again when the polygons, mask or cell size change.
+ *
+ * @param PropertyChangedEvent - The property that changed.
+ */
+void URegionCollapseMode::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	const FName PropertyName = PropertyChangedEvent.GetMemberPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(URegionCollapseMode, Polygons) || PropertyName == GET_MEMBER_NAME_CHECKED(URegionCollapseMode, Mask) || PropertyName == GET_MEMBER_NAME_CHECKED(URegionCollapseMode, MaskExtent) || PropertyName == GET_MEMBER_NAME_CHECKED(URegionCollapseMode, MaskThreshold) || PropertyName == GET_MEMBER_NAME_CHECKED(URegionCollapseMode, CellSize))
+	{
+		RebuildRegion();
+	}
+}
+#endif
+
+/**
+ * Rasterizes the polygons and mask into the cached region.
+ */
+void URegionCollapseMode::RebuildRegion() const
+{
+	//Cover every polygon and the mask.
+	FBox2D Bounds = FBox2D(ForceInit);
+	for (const FTerrainRegionPolygon& EachPolygon : Polygons)
+	{
+		for (const FVector2D& EachPoint : EachPolygon.Points)
+		{
+			Bounds += EachPoint;
+		}
+	}
+
+	const FBox2D MaskBounds = FBox2D(-MaskExtent.GetAbs(), MaskExtent.GetAbs());
+	if (IsValid(Mask))
+	{
+		Bounds += MaskBounds;
+	}
+
+	//Configs already given to the worker keep the grid they were made with.
+	TSharedRef<FTerrainRegionGrid, ESPMode::ThreadSafe> NewRegionGrid = MakeShared<FTerrainRegionGrid, ESPMode::ThreadSafe>(Bounds, CellSize);
+	for (const FTerrainRegionPolygon& EachPolygon : Polygons)
+	{
+		NewRegionGrid->AddPolygon(EachPolygon.Points);
+	}
+	NewRegionGrid->AddMask(Mask, MaskBounds, MaskThreshold);
+	RegionGrid = NewRegionGrid;
+	RegionMaskSourceId = GetMaskSourceId();
+}
 
-	SuperPositionIndex = FIntVector(0, RandomStream.RandHelper(SpawnableTiles.Num()), 0);
-	return CurrentShape.Vertices.IsEmpty() && !SpawnableTiles.IsEmpty() && !SuperPositions.IsEmpty() && !SuperPositions[0].IsEmpty() && !SuperPositions[0][0].IsEmpty();
+/**
+ * Gets the identifier of the mask's source data, which changes whenever the source data does.
+ *
+ * @return The identifier of the mask's source data, or an invalid identifier if there is no mask.
+ */
+FGuid URegionCollapseMode::GetMaskSourceId() const
+{
+	return IsValid(Mask) ? Mask->Source.GetId() : FGuid();
 }
 
 /**
@@ -427,12 +1078,25 @@ bool URectangularCollapseMode::GetSuperPositionsToCollapse(FIntVector& SuperPosi
  *
  * @param TerrainTransform - The transform to apply to the bounds.
  */
-void URectangularCollapseMode::DrawGenerationBounds() const
+void URegionCollapseMode::DrawGenerationBounds() const
 {
 	FlushPersistentDebugLines(GetWorld());
-	DrawDebugBox(GetWorld(), TerrainTransform.GetTranslation(), FVector(Extent, 0), TerrainTransform.GetRotation(), FColor::Magenta, true, 10, 0U, 150);
+	for (const FTerrainRegionPolygon& EachPolygon : Polygons)
+	{
+		for (int PointIndex = 0; PointIndex < EachPolygon.Points.Num(); PointIndex++)
+		{
+			const FVector Start = TerrainTransform.TransformPosition(FVector(EachPolygon.Points[PointIndex], 0));
+			const FVector End = TerrainTransform.TransformPosition(FVector(EachPolygon.Points[(PointIndex + 1) % EachPolygon.Points.Num()], 0));
+			DrawDebugLine(GetWorld(), Start, End, FColor::Magenta, true, 10, 0U, 150);
+		}
+	}
+
+	if (IsValid(Mask))
+	{
+		DrawDebugBox(GetWorld(), TerrainTransform.GetTranslation(), FVector(MaskExtent, 0), TerrainTransform.GetRotation(), FColor::Magenta, true, 10, 0U, 150);
+	}
 }
 
-/* /\ ========================= /\ *\
-|  /\ URectangularCollapseMode  /\  |
-\* /\ ========================= /\ */
+/* /\ ==================== /\ *\
+|  /\ URegionCollapseMode  /\  |
+\* /\ ==================== /\ */
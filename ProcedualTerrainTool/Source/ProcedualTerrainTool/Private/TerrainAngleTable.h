@@ -0,0 +1,100 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "TerrainShape.h"
+
+/**
+ * A table of the interior angles that can be filled by combining the corners of a set of tiles.
+ */
+struct FTerrainAngleTable
+{
+public:
+	/**
+	 * Constructs an empty table that treats every angle as fillable.
+	 */
+	FTerrainAngleTable()
+	{
+
+	}
+
+	/**
+	 * Compiles the table of fillable angles from the corners of the given tiles.
+	 * 
+	 * @param TileShapes - The shapes of the tiles that can be used to fill gaps.
+	 */
+	FTerrainAngleTable(const TArray<FTerrainShape>& TileShapes)
+	{
+		//Gather distinct corner angles
+		TArray<double> CornerAngles = TArray<double>();
+		for (const FTerrainShape& EachTileShape : TileShapes)
+		{
+			for (const FTerrainVertex& EachVertex : EachTileShape.Vertices)
+			{
+				if (!CornerAngles.ContainsByPredicate([&EachVertex](const double CornerAngle) { return FMath::IsNearlyEqual(CornerAngle, EachVertex.Angle, BinWidth / 4); }))
+				{
+					CornerAngles.Emplace(EachVertex.Angle);
+				}
+			}
+		}
+
+		//Find every sum of corner angles up to a full turn
+		const int NumBins = FMath::CeilToInt(TWO_PI / BinWidth);
+		TArray<double> BinSums = TArray<double>();
+		BinSums.Init(0, NumBins + 1);
+		FillableAngles.Init(false, NumBins + 1);
+		FillableAngles[0] = true;
+
+		for (int Bin = 0; Bin <= NumBins; Bin++)
+		{
+			if (!FillableAngles[Bin])
+			{
+				continue;
+			}
+
+			for (const double EachCornerAngle : CornerAngles)
+			{
+				const double NewSum = BinSums[Bin] + EachCornerAngle;
+				const int NewBin = FMath::RoundToInt(NewSum / BinWidth);
+				if (NewBin > Bin && NewBin <= NumBins && !FillableAngles[NewBin])
+				{
+					FillableAngles[NewBin] = true;
+					BinSums[NewBin] = NewSum;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Determines whether the gap at a vertex with the given interior angle can be closed by some combination of tile corners.
+	 * 
+	 * @param InteriorAngle - The interior angle of the filled terrain at the vertex.
+	 * @return Whether or not the gap can be filled.
+	 */
+	bool IsFillable(const double InteriorAngle) const
+	{
+		if (FillableAngles.IsEmpty())
+		{
+			return true;
+		}
+
+		const int GapBin = FMath::RoundToInt((TWO_PI - InteriorAngle) / BinWidth);
+		for (int Bin = FMath::Max(GapBin - BinTolerance, 0); Bin <= FMath::Min(GapBin + BinTolerance, FillableAngles.Num() - 1); Bin++)
+		{
+			if (FillableAngles[Bin])
+			{
+				return true;
+			}
+		}
+		return GapBin < 0;
+	}
+
+private:
+	//The size in radians of each entry in the table.
+	static constexpr double BinWidth = 0.001;
+	//How many entries either side of a gap to accept to account for rounding.
+	static constexpr int BinTolerance = 2;
+
+	//Whether or not the gap in each entry can be filled.
+	TArray<bool> FillableAngles = TArray<bool>();
+};
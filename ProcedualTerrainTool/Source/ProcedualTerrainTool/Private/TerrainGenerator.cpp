@@ -6,10 +6,40 @@
 #include "DrawDebugHelpers.h"
 #include "Async/AsyncWork.h"
 #include "Async/Async.h"
+#include "Misc/ScopeLock.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/IConsoleManager.h"
+#include "Async/ParallelFor.h"
+#include "Algo/BinarySearch.h"
 #include "TerrainTileData.h"
 
 DEFINE_LOG_CATEGORY(LogTerrainTool);
 
+static TAutoConsoleVariable<int32> CVarTerrainGenerationThreads(
+	TEXT("PTT.GenerationThreads"),
+	0,
+	TEXT("The number of threads shared by all terrain generators. 0 uses one less than the number of cores."));
+
+static TAutoConsoleVariable<float> CVarTerrainGenerationTimeSlice(
+	TEXT("PTT.GenerationTimeSlice"),
+	5,
+	TEXT("How long in milliseconds a terrain generator with a priority of 1 runs before the next waiting generator gets a turn."));
+
+static TAutoConsoleVariable<int32> CVarTerrainParallelRefreshSockets(
+	TEXT("PTT.ParallelRefreshSockets"),
+	16,
+	TEXT("The fewest stale sockets a terrain generator re-evaluates on several threads at once. Smaller refreshes are not worth the overhead."));
+
+static TAutoConsoleVariable<int32> CVarTerrainConcurrentCollapses(
+	TEXT("PTT.ConcurrentCollapses"),
+	4,
+	TEXT("The fewest collapses in a batch a terrain generator with parallel refreshes commits on several threads at once. Smaller batches are not worth the overhead."));
+
+static TAutoConsoleVariable<int32> CVarTerrainFrozenSocketsToCompact(
+	TEXT("PTT.FrozenSocketsToCompact"),
+	64,
+	TEXT("The fewest sockets a terrain generator must freeze before it takes long runs of frozen sockets out of its frontier. It also waits until it has frozen as many sockets as are active. 0 never takes them out."));
+
 /* \/ ================== \/ *\
 |  \/ ATerrainGenerator  \/  |
 \* \/ ================== \/ */
@@ -23,51 +53,98 @@ ATerrainGenerator::ATerrainGenerator()
 	RootComponent->SetMobility(EComponentMobility::Static);
 }
 
+/**
+ * Ends the generation and waits for the retiring worker to stop without spawning its last tiles, so that no worker outlives the world.
+ *
+ * @param EndPlayReason - Why play is ending.
+ */
+void ATerrainGenerator::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	EndGeneration();
+	bDiscardRetiringWorker = true;
+	WaitForRetiringWorker();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+/**
+ * Deletes the workers without spawning their last tiles. Editor actors are destroyed without ending play, and their world may already be gone.
+ */
+void ATerrainGenerator::BeginDestroy()
+{
+	//Deleting a worker stops it and waits for the scheduler to release it.
+	delete TerrainGenerationWorker;
+	TerrainGenerationWorker = NULL;
+	bDiscardRetiringWorker = true;
+	WaitForRetiringWorker();
+
+	Super::BeginDestroy();
+}
+
 /**
  * Temporary function that can be used to debug the terrain generator.
  */
 void ATerrainGenerator::Test()
 {
 	FlushPersistentDebugLines(GetWorld());
-	for (int i =0; i < TerrainShape.Num(); i++)
+	const FTerrainShapeSnapshot Snapshot = GetTerrainShapeSnapshot();
+	const FTerrainShape& DebugShape = *Snapshot;
+	for (int i =0; i < DebugShape.Num(); i++)
 	{
-		DrawDebugDirectionalArrow(GetWorld(), FVector(TerrainShape.Vertices[i].Location, FMath::Lerp(-75, 100, i / (float)(TerrainShape.Num() -1))), FVector(TerrainShape.Vertices[(i + 1) % TerrainShape.Num()].Location, FMath::Lerp(-75,100, ((i + 1) % TerrainShape.Num())/(float)(TerrainShape.Num()-1))), 200, FColor::MakeRandomColor(), true, 0, 0U, 5);
+		DrawDebugDirectionalArrow(GetWorld(), FVector(DebugShape.Vertices[i].Location, FMath::Lerp(-75, 100, i / (float)(DebugShape.Num() -1))), FVector(DebugShape.Vertices[(i + 1) % DebugShape.Num()].Location, FMath::Lerp(-75,100, ((i + 1) % DebugShape.Num())/(float)(DebugShape.Num()-1))), 200, FColor::MakeRandomColor(), true, 0, 0U, 5);
 	}
 }
 
 /**
- * Begins the terrain generation process.
+ * Begins the terrain generation process. Reuses the running worker if its tiles and settings have not changed.
  */
 void ATerrainGenerator::BeginGeneration()
 {
 	if (IsValid(GenerationMode))
 	{
-		for (FTerrainTileSpawnData EachSpawnableTile : SpawnableTiles)
+		if (EnsureGenerationWorker())
 		{
-			if (!IsValid(EachSpawnableTile.TileData))
-			{
-				UE_LOG(LogTerrainTool, Error, TEXT("Not all spawnable tiles are valid"));
-				return;
-			}
-		}
+			GenerationMode->ErrorLocation = FVector::ZeroVector;
 
-		if (FPlatformProcess::SupportsMultithreading())
-		{
-			if ((bGenerateUntilSuccessful || !bUseManualSeed) && Seed.GetCurrentSeed() == Seed.GetInitialSeed())
+			FTerrainGenerationCommand Command = FTerrainGenerationCommand();
+			Command.Type = ETerrainGenerationCommandType::RunMode;
+			Command.Mode = GenerationMode->CreateConfig();
+			EnqueueCommand(Command);
+
+			if (bGenerateUntilSuccessful && RestartSchedule != ETerrainRestartSchedule::None)
 			{
-				Seed.GenerateNewSeed();
+				GetWorld()->GetTimerManager().SetTimer(StallCheckTimerHandle, this, &ATerrainGenerator::CheckForStall, .1, true);
 			}
 
-			EndGeneration();
-			TerrainGenerationWorker = new FTerrainGenerationWorker(SpawnableTiles, GenerationMode, Seed, PredictionDepth, TerrainShape);
-
-			GetWorld()->GetTimerManager().SetTimer(TileRefreshTimerHandle, this, &ATerrainGenerator::RefreshTiles, .1, true);
-
 			GenerationMode->DrawGenerationBounds();
 		}
-		else
+	}
+	else
+	{
+		UE_LOG(LogTerrainTool, Error, TEXT("Select a generation mode"));
+	}
+}
+
+/**
+ * Places a single tile as close to a location as possible without restarting the worker.
+ *
+ * @param Location - Where to place the tile, in world space.
+ * @param TileIndex - The index of the spawnable tile to place.
+ */
+void ATerrainGenerator::PlaceTile(FVector Location, int TileIndex)
+{
+	if (IsValid(GenerationMode))
+	{
+		if (EnsureGenerationWorker())
 		{
-			UE_LOG(LogTerrainTool, Error, TEXT("Platform does not support multi threading"));
+			GenerationMode->ErrorLocation = FVector::ZeroVector;
+
+			FTerrainGenerationCommand Command = FTerrainGenerationCommand();
+			Command.Type = ETerrainGenerationCommandType::PlaceTile;
+			Command.Mode = GenerationMode->CreateConfig();
+			Command.Location = Location;
+			Command.TileIndex = FMath::Clamp(TileIndex, 0, SpawnableTiles.Num() - 1);
+			EnqueueCommand(Command);
 		}
 	}
 	else
@@ -77,24 +154,141 @@ void ATerrainGenerator::BeginGeneration()
 }
 
 /**
- * Stops the generation before the terrain is finished generating.
+ * Pauses the generation without discarding any progress. Tiles can still be placed while paused.
  */
-void ATerrainGenerator::EndGeneration()
+void ATerrainGenerator::PauseGeneration()
 {
-	FlushPersistentDebugLines(GetWorld());
+	if (TerrainGenerationWorker)
+	{
+		FTerrainGenerationCommand Command = FTerrainGenerationCommand();
+		Command.Type = ETerrainGenerationCommandType::Pause;
+		EnqueueCommand(Command);
+	}
+}
 
-	//Terrain generation worker cleanup
+/**
+ * Resumes a paused generation.
+ */
+void ATerrainGenerator::ResumeGeneration()
+{
 	if (TerrainGenerationWorker)
 	{
-		if (!TerrainGenerationWorker->IsTerrainFinishedGenerating())
+		FTerrainGenerationCommand Command = FTerrainGenerationCommand();
+		Command.Type = ETerrainGenerationCommandType::Resume;
+		EnqueueCommand(Command);
+	}
+}
+
+/**
+ * Makes sure there is a worker compiled for the current tiles and settings, creating a new one if needed.
+ *
+ * @return Whether or not there is a worker to give commands to.
+ */
+bool ATerrainGenerator::EnsureGenerationWorker()
+{
+	for (FTerrainTileSpawnData EachSpawnableTile : SpawnableTiles)
+	{
+		if (!IsValid(EachSpawnableTile.TileData))
 		{
-			TerrainGenerationWorker->Stop();
+			UE_LOG(LogTerrainTool, Error, TEXT("Not all spawnable tiles are valid"));
+			return false;
 		}
+	}
+
+	const bool bUseScheduler = !bGenerateOnGameThread && FPlatformProcess::SupportsMultithreading();
+
+	//Copy everything the worker needs so that it never reads this or the tile data.
+	FTerrainSolverConfig SolverConfig = FTerrainSolverConfig();
+	for (const FTerrainTileSpawnData& EachSpawnableTile : SpawnableTiles)
+	{
+		SolverConfig.Tiles.Emplace(FTerrainTileDefinition(EachSpawnableTile));
+	}
+	SolverConfig.Lookahead.MaxDepth = PredictionDepth;
+	SolverConfig.Lookahead.bAdaptive = bAdaptivePrediction;
+	SolverConfig.Lookahead.AdaptiveThreshold = AdaptivePredictionThreshold;
+	SolverConfig.Lookahead.NodeBudget = PredictionNodeBudget;
+	SolverConfig.Lookahead.bPruneUnfillableAngles = bPruneUnfillableAngles;
+	SolverConfig.ShapeSnapshotInterval = FrontierSnapshotInterval;
+	SolverConfig.CollapseBatchSize = CollapseBatchSize;
+	SolverConfig.bParallelRefresh = bParallelRefresh;
+	SolverConfig.bCounterBasedRandom = bCounterBasedRandom;
+	SolverConfig.MacroTiles.SampledClusters = MacroTileCount;
+	SolverConfig.MacroTiles.MaxClusterSize = MaxMacroTileSize;
+	SolverConfig.MacroTiles.Groups = MacroTileGroups;
+
+	if (TerrainGenerationWorker && TerrainGenerationWorker->CanContinueWith(SolverConfig, bUseScheduler))
+	{
+		TerrainGenerationWorker->SetPriority(GenerationPriority);
+		return true;
+	}
+
+	//The new worker continues from the shape the previous worker stopped at.
+	EndGeneration();
+	WaitForRetiringWorker();
+
+	if ((bGenerateUntilSuccessful || !bUseManualSeed) && Seed.GetCurrentSeed() == Seed.GetInitialSeed())
+	{
+		Seed.GenerateNewSeed();
+	}
+
+	TerrainGenerationWorker = new FTerrainGenerationWorker(SolverConfig, Seed, FSimpleDelegate::CreateUObject(this, &ATerrainGenerator::RefreshTiles), TerrainShape, bUseScheduler);
+	TerrainGenerationWorker->SetPriority(GenerationPriority);
+	return true;
+}
+
+/**
+ * Stops the generation and shuts down the worker. Returns immediately, the worker finishes stopping in the background.
+ */
+void ATerrainGenerator::EndGeneration()
+{
+	FlushPersistentDebugLines(GetWorld());
+	GetWorldTimerManager().ClearTimer(StallCheckTimerHandle);
+	GetWorldTimerManager().ClearTimer(GameThreadSliceTimerHandle);
+
+	//Nothing else runs a game thread worker, so it can be finished straight away.
+	if (TerrainGenerationWorker && !TerrainGenerationWorker->UsesScheduler())
+	{
+		TerrainGenerationWorker->Stop();
+		ReadWorkerOutput(TerrainGenerationWorker);
+		TerrainShapeSnapshot = TerrainGenerationWorker->GetTerrainShapeSnapshot();
+		TerrainShape = *TerrainShapeSnapshot;
+		Seed = TerrainGenerationWorker->GetRandomStream();
 
 		delete TerrainGenerationWorker;
 		TerrainGenerationWorker = NULL;
 	}
 
+	//Terrain generation worker cleanup
+	if (TerrainGenerationWorker)
+	{
+		//Only one worker is retired at a time.
+		WaitForRetiringWorker();
+
+		TerrainGenerationWorker->Stop();
+		RetiringWorker = MakeShareable(TerrainGenerationWorker);
+		TerrainGenerationWorker = NULL;
+		bDiscardRetiringWorker = false;
+
+		//Wait for the scheduler to release the worker off the game thread so that stopping never blocks on the current refresh.
+		TSharedPtr<FTerrainGenerationWorker, ESPMode::ThreadSafe> WorkerToJoin = RetiringWorker;
+		TWeakObjectPtr<ATerrainGenerator> WeakThis = this;
+		RetiringWorkerTeardown = Async(EAsyncExecution::ThreadPool, [WorkerToJoin]()
+			{
+				WorkerToJoin->WaitForCompletion();
+			},
+			[WeakThis, WorkerToJoin]()
+			{
+				//If this has been destroyed, the teardown holds the last reference to the worker and deletes it.
+				AsyncTask(ENamedThreads::GameThread, [WeakThis, WorkerToJoin]()
+					{
+						if (WeakThis.IsValid())
+						{
+							WeakThis->FinishRetiringWorker();
+						}
+					});
+			});
+	}
+
 	NumberOfTilesSpawned = 0;
 }
 
@@ -104,6 +298,7 @@ void ATerrainGenerator::EndGeneration()
 void ATerrainGenerator::Reset()
 {
 	EndGeneration();
+	bDiscardRetiringWorker = true;
 
 	for (AActor* EachTerrainActor : TileActors)
 	{
@@ -112,52 +307,201 @@ void ATerrainGenerator::Reset()
 	TileActors.Empty();
 
 	TerrainShape = FTerrainShape();
+	TerrainShapeSnapshot.Reset();
 
 	Seed.Reset();
 
-	GenerationMode->ErrorLocation = FVector::ZeroVector;
+	RestartCount = 0;
+
+	if (IsValid(GenerationMode))
+	{
+		GenerationMode->ErrorLocation = FVector::ZeroVector;
+	}
+}
+
+/**
+ * Gets the latest shape of the terrain without copying it. Safe to call while the terrain is generating.
+ *
+ * @return An immutable snapshot of the shape of the terrain.
+ */
+FTerrainShapeSnapshot ATerrainGenerator::GetTerrainShapeSnapshot() const
+{
+	if (TerrainGenerationWorker)
+	{
+		return TerrainGenerationWorker->GetTerrainShapeSnapshot();
+	}
+
+	if (TerrainShapeSnapshot.IsValid())
+	{
+		return TerrainShapeSnapshot;
+	}
+
+	//Only reached before anything has been generated since loading.
+	return FTerrainShapeSnapshot(MakeShared<FTerrainShape, ESPMode::ThreadSafe>(TerrainShape));
 }
 
 /**
- * Spawns any new tiles created by the worker and shuts down worker if complete.
+ * Gets how quickly the current generation is filling its area.
+ *
+ * @return A snapshot of the generation progress. Empty if nothing is generating.
+ */
+FTerrainGenerationProgress ATerrainGenerator::GetGenerationProgress() const
+{
+	if (TerrainGenerationWorker)
+	{
+		return TerrainGenerationWorker->GetProgress();
+	}
+	return FTerrainGenerationProgress();
+}
+
+/**
+ * Spawns any new tiles created by the worker and handles errors once it has carried out every command. Called on the game thread whenever the worker has an update.
  */
 void ATerrainGenerator::RefreshTiles()
 {
 	if (TerrainGenerationWorker)
 	{
-		for (NumberOfTilesSpawned; NumberOfTilesSpawned < TerrainGenerationWorker->GetTerrainTiles().Num(); NumberOfTilesSpawned++)
-		{
-			SpawnTile(TerrainGenerationWorker->GetTerrainTiles()[NumberOfTilesSpawned]);
-		}
+		//Acknowledge before reading so that any later update sends a new notification.
+		TerrainGenerationWorker->AcknowledgeUpdate();
+
+		//Check for completion first so that no tiles placed before completion are missed.
+		const bool bFinishedGenerating = TerrainGenerationWorker->IsTerrainFinishedGenerating();
 
-		TerrainShape = TerrainGenerationWorker->GetTerrainShape();
+		ReadWorkerOutput(TerrainGenerationWorker);
+		TerrainShapeSnapshot = TerrainGenerationWorker->GetTerrainShapeSnapshot();
 		
-		if (TerrainGenerationWorker->IsTerrainFinishedGenerating())
+		//The worker is kept so that later commands start from warm superpositions.
+		if (bFinishedGenerating)
 		{
-			TerrainGenerationWorker->Stop();
-			delete TerrainGenerationWorker;
-			TerrainGenerationWorker = NULL;
-			GetWorldTimerManager().ClearTimer(TileRefreshTimerHandle);
+			TerrainShape = *TerrainShapeSnapshot;
+			GetWorldTimerManager().ClearTimer(StallCheckTimerHandle);
 			FlushPersistentDebugLines(GetWorld());
 
-			if (!GenerationMode->ErrorLocation.IsZero())
+			if (IsValid(GenerationMode) && !GenerationMode->ErrorLocation.IsZero())
 			{
 				if (bGenerateUntilSuccessful)
 				{
-					Reset();
-					BeginGeneration();
+					RestartGeneration();
 				}
 				else
 				{
 					DrawDebugPoint(GetWorld(), GenerationMode->ErrorLocation, 50, FColor::Red, true);
 				}
 			}
+			else
+			{
+				RestartCount = 0;
+			}
 		}
 	}
-	else
+}
+
+/**
+ * Spawns the tiles a worker has placed and records the errors it has reported since they were last read.
+ *
+ * @param Worker - The worker to read from.
+ */
+void ATerrainGenerator::ReadWorkerOutput(FTerrainGenerationWorker* Worker)
+{
+	TArray<FTerrainTileInstanceData> NewTiles = TArray<FTerrainTileInstanceData>();
+	NumberOfTilesSpawned += Worker->DequeueTerrainTiles(NewTiles);
+	for (const FTerrainTileInstanceData& EachNewTile : NewTiles)
+	{
+		SpawnTile(EachNewTile);
+	}
+
+	FVector NewErrorLocation;
+	while (Worker->DequeueErrorLocation(NewErrorLocation))
+	{
+		if (IsValid(GenerationMode))
+		{
+			GenerationMode->ErrorLocation = NewErrorLocation;
+		}
+	}
+}
+
+/**
+ * Applies the final results of the retiring worker and deletes it once the scheduler has released it.
+ */
+void ATerrainGenerator::FinishRetiringWorker()
+{
+	if (RetiringWorker && RetiringWorkerTeardown.IsReady())
+	{
+		if (!bDiscardRetiringWorker)
+		{
+			ReadWorkerOutput(RetiringWorker.Get());
+			TerrainShapeSnapshot = RetiringWorker->GetTerrainShapeSnapshot();
+			TerrainShape = *TerrainShapeSnapshot;
+			Seed = RetiringWorker->GetRandomStream();
+		}
+
+		//The teardown may still hold the worker, in which case it deletes it once it lets go.
+		RetiringWorker.Reset();
+	}
+}
+
+/**
+ * Blocks until the retiring worker has stopped and applies its results. Bounded by the worker's cancellation latency.
+ */
+void ATerrainGenerator::WaitForRetiringWorker()
+{
+	if (RetiringWorker)
+	{
+		RetiringWorkerTeardown.Wait();
+		FinishRetiringWorker();
+	}
+}
+
+/**
+ * Restarts the generation if it has stalled according to the restart schedule.
+ */
+void ATerrainGenerator::CheckForStall()
+{
+	if (TerrainGenerationWorker && !TerrainGenerationWorker->IsTerrainFinishedGenerating() && !TerrainGenerationWorker->IsPaused() && ShouldRestartGeneration())
+	{
+		UE_LOG(LogTerrainTool, Log, TEXT("Generation stalled, restarting (attempt %i)"), RestartCount + 2);
+		RestartGeneration();
+	}
+}
+
+/**
+ * Runs a game thread worker for one frame's budget and spawns its new tiles. Reschedules itself while there is work left.
+ */
+void ATerrainGenerator::RunGameThreadSlice()
+{
+	//This slice's timer still counts as existing while it runs, so forget it before anything can queue the next slice.
+	GameThreadSliceTimerHandle.Invalidate();
+
+	if (TerrainGenerationWorker && !TerrainGenerationWorker->UsesScheduler())
+	{
+		TerrainGenerationWorker->RunSlice(GameThreadBudget / 1000.0);
+
+		const FTerrainGenerationProgress Progress = TerrainGenerationWorker->GetProgress();
+		UE_LOG(LogTerrainTool, Verbose, TEXT("Placed %i tiles in %i steps covering %.0f units in %.2f seconds with an average frontier of %.1f sockets"), Progress.TilesPlaced, Progress.Steps, Progress.AreaFilled, Progress.ElapsedTime, Progress.GetAverageFrontierLength());
+
+		//Spawn straight away rather than waiting for the notification.
+		RefreshTiles();
+
+		//Refreshing may have ended or restarted the generation. A restart queues its own slice, so only one is ever pending.
+		if (TerrainGenerationWorker && TerrainGenerationWorker->HasWork() && !GetWorldTimerManager().TimerExists(GameThreadSliceTimerHandle))
+		{
+			GameThreadSliceTimerHandle = GetWorldTimerManager().SetTimerForNextTick(this, &ATerrainGenerator::RunGameThreadSlice);
+		}
+	}
+}
+
+/**
+ * Gives a command to the worker, and makes sure a game thread worker gets a slice to carry it out.
+ *
+ * @param Command - The command to carry out.
+ */
+void ATerrainGenerator::EnqueueCommand(const FTerrainGenerationCommand& Command)
+{
+	TerrainGenerationWorker->EnqueueCommand(Command);
+
+	if (!TerrainGenerationWorker->UsesScheduler() && !GetWorldTimerManager().TimerExists(GameThreadSliceTimerHandle))
 	{
-		FlushPersistentDebugLines(GetWorld());
-		GetWorldTimerManager().ClearTimer(TileRefreshTimerHandle);
+		GameThreadSliceTimerHandle = GetWorldTimerManager().SetTimerForNextTick(this, &ATerrainGenerator::RunGameThreadSlice);
 	}
 }
 
@@ -196,166 +540,2407 @@ void ATerrainGenerator::SpawnTile(FTerrainTileInstanceData TileData)
 	}
 }
 
-/* /\ ================== /\ *\
-|  /\ ATerrainGenerator  /\  |
-\* /\ ================== /\ */
-
-
-
-/* \/ ========================= \/ *\
-|  \/ FTerrainGenerationWorker  \/  |
-\* \/ ========================= \/ */
-
 /**
- * Determines whether the terrain is finished generating.
+ * Determines whether the current attempt has stalled according to the restart schedule.
  *
- * @return Whether or not the terrain is finished generating.
+ * @return Whether or not the current attempt should be abandoned and reseeded.
  */
-bool FTerrainGenerationWorker::IsTerrainFinishedGenerating()
+bool ATerrainGenerator::ShouldRestartGeneration() const
 {
-	return bCompleated;
-}
-
-/**
- * Creates a FTerrainGenerationWorker able to compute superposition collapses of the given tiles.
- *
- * @param OutTiles - Will be written to as superpositions are collapsed.
- * @param UseableTiles - The tiles that will be used to generate the terrain.
- * @param Mode - The method used for deciding which superposition to collapse next.
- * @param PredictionDepth - How many iterations into the future to search for failed superpositions.
- */
-FTerrainGenerationWorker::FTerrainGenerationWorker(TArray<FTerrainTileSpawnData> Tiles, UProcedualCollapseMode* Mode, FRandomStream& GenerationStream, const int PredictionDepth, FTerrainShape CurrentTerrainShape) :
-	bStopped(false),
-	CollapseMode(Mode),
-	CollapsePredictionDepth(PredictionDepth),
-	UseableTiles(Tiles),
-	RandomStream(GenerationStream),
-	Shape(CurrentTerrainShape),
-	bCompleated(false)
-{ 
-	//Create thread.
-	Thread = FRunnableThread::Create(this, TEXT("FTerrainGenerationWorker"), 0, TPri_BelowNormal);
-
-	//Initialize output
-	TerrainTiles = TArray<FTerrainTileInstanceData>();
-
-	//Set up generation constants.
-	TileShapes = TArray<FTerrainShape>();
-	BaseSuperPositions = TArray<TArray<bool>>();
-	MaxTileVertices = 0;
-
-	for (FTerrainTileSpawnData EachUseableTile : UseableTiles)
+	if (!TerrainGenerationWorker || RestartSchedule == ETerrainRestartSchedule::None)
 	{
-		TileShapes.Emplace(FTerrainShape(EachUseableTile.TileData->Verticies, EachUseableTile.TileData->FaceTypes));
-		MaxTileVertices = FMath::Max(EachUseableTile.TileData->Verticies.Num(), MaxTileVertices);
-
-		TArray<bool> Faces = TArray<bool>();
-		Faces.Init(true, EachUseableTile.TileData->Verticies.Num());
-		BaseSuperPositions.Emplace(Faces);
+		return false;
 	}
 
-	SuperPositions = TArray<TArray<TArray<bool>>>();
-	if (Shape.Num() == 0)
+	float StallBudget = RestartUnitTime;
+	switch (RestartSchedule)
 	{
-		SuperPositions.Emplace(BaseSuperPositions);
+	case ETerrainRestartSchedule::Luby:
+		StallBudget *= UPTTMath::Luby(RestartCount);
+		break;
+
+	case ETerrainRestartSchedule::Geometric:
+		StallBudget *= FMath::Pow(RestartGrowthFactor, RestartCount);
+		break;
+
+	default:
+		break;
 	}
-	else
+
+	const FTerrainGenerationProgress Progress = TerrainGenerationWorker->GetProgress();
+	if (Progress.TimeSinceLastCollapse > StallBudget)
 	{
-		RefreshSuperPositions(Shape.Num());
+		return true;
 	}
-	return;
-}
 
-/**
- * Destructs this and handles thread deletion.
- */
-FTerrainGenerationWorker::~FTerrainGenerationWorker()
-{ 
-	delete Thread;
-	Thread = NULL; 
+	return MinimumFillRate > 0 && Progress.ElapsedTime > StallBudget && Progress.GetFillRate() < MinimumFillRate;
 }
 
 /**
- * Begins the process of terrain generation.
- *
- * @return true
+ * Abandons the current attempt and begins a new one with a new seed.
  */
-bool FTerrainGenerationWorker::Init()
+void ATerrainGenerator::RestartGeneration()
 {
-	bCompleated = false;
+	const int NextRestartCount = RestartCount + 1;
+	Reset();
+	RestartCount = NextRestartCount;
+	BeginGeneration();
+}
+
+/* /\ ================== /\ *\
+|  /\ ATerrainGenerator  /\  |
+\* /\ ================== /\ */
 
-	UE_LOG(LogTerrainTool, Log, TEXT("--- Super Position Collapse Started ---"));
 
-	return true;
-}
+
+/* \/ ===================== \/ *\
+|  \/ FTerrainTileCatalog  \/  |
+\* \/ ===================== \/ */
+
+//A catalog compiled by an earlier generation, along with what it was compiled from.
+struct FCompiledTileCatalog
+{
+	uint32 Hash = 0;
+	TArray<FTerrainTileDefinition> TileDefinitions = TArray<FTerrainTileDefinition>();
+	FTerrainMacroTileSettings MacroTileSettings = FTerrainMacroTileSettings();
+	TSharedPtr<const FTerrainTileCatalog, ESPMode::ThreadSafe> Catalog = nullptr;
+};
+
+//The most recently compiled catalogs, oldest first. Shared by every worker.
+static TArray<FCompiledTileCatalog> CompiledTileCatalogs = TArray<FCompiledTileCatalog>();
+//Guards the compiled catalogs.
+static FCriticalSection CompiledTileCatalogsLock;
+//The most compiled catalogs kept at once.
+static constexpr int MaxCompiledTileCatalogs = 8;
 
 /**
- * Repeatedly collapses superpositions in order to generate the terrain.
+ * Hashes the tiles and settings a catalog is compiled from.
  *
- * @return 0
+ * @param TileDefinitions - The definitions of the spawnable tiles.
+ * @param MacroTileSettings - How the macro tiles are found.
+ * @return The hash of everything the catalog depends on.
  */
-uint32 FTerrainGenerationWorker::Run()
-{ 
-	//Initial wait before starting 
-	FPlatformProcess::Sleep(0.03);	
+static uint32 GetTileCatalogHash(const TArray<FTerrainTileDefinition>& TileDefinitions, const FTerrainMacroTileSettings& MacroTileSettings)
+{
+	uint32 Hash = HashCombine(GetTypeHash(MacroTileSettings.SampledClusters), GetTypeHash(MacroTileSettings.MaxClusterSize));
+	for (const FTerrainMacroTileGroup& EachGroup : MacroTileSettings.Groups)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(EachGroup.SpawnWeight));
+		for (const int EachTileIndex : EachGroup.TileIndices)
+		{
+			Hash = HashCombine(Hash, GetTypeHash(EachTileIndex));
+		}
+	}
 
-	while (!(bCompleated || bStopped))
+	for (const FTerrainTileDefinition& EachDefinition : TileDefinitions)
 	{
-		if (!SuperPositions.IsEmpty())
+		Hash = HashCombine(Hash, GetTypeHash(EachDefinition.SpawnWeight));
+		for (const FVector2D& EachVertex : EachDefinition.Verticies)
 		{
-			FIntVector CollapseResult;
-			bCompleated = !CollapseMode->GetSuperPositionsToCollapse(CollapseResult, Shape, SuperPositions, UseableTiles, RandomStream);
-			bCompleated = !CollapseSuperPosition(CollapseResult) || bCompleated;
+			Hash = HashCombine(Hash, GetTypeHash(EachVertex));
 		}
-		else
+		for (const FName& EachFaceType : EachDefinition.FaceTypes)
 		{
-			FPlatformProcess::Sleep(0.1);
+			Hash = HashCombine(Hash, GetTypeHash(EachFaceType));
 		}
 	}
-
-
-	UE_LOG(LogTerrainTool, Log, TEXT("---- Super Position Collapse Ended ----"));
-
-	return 0;
+	return Hash;
 }
 
 /**
- * Stops the generation process regardless of completion.
+ * Copies the definition of a spawnable tile. Must be called on the game thread.
+ *
+ * @param SpawnData - The tile to copy. Must have valid tile data.
  */
-void FTerrainGenerationWorker::Stop()
-{ 
-	bStopped = true;
+FTerrainTileDefinition::FTerrainTileDefinition(const FTerrainTileSpawnData& SpawnData) :
+	Verticies(SpawnData.TileData->Verticies),
+	FaceTypes(SpawnData.TileData->FaceTypes),
+	SpawnWeight(SpawnData.SpawnWeight)
+{
+
 }
 
 /**
- * Attempts to collapse a super position at a given index.
+ * Compiles the given tiles into solver tiles, then fits together the user defined macro tile groups. The sampled macro tiles are added by SampleMacroTiles.
  *
- * @param Index - X = Socket to connect to, Y = Tile to add, Z = Socket on tile to connect to.
- * @return Whether or not the collapse was successful.
+ * @param TileDefinitions - The definitions of the spawnable tiles to compile.
+ * @param MacroTileSettings - How to find the macro tiles.
  */
-bool FTerrainGenerationWorker::CollapseSuperPosition(FIntVector Index)
+FTerrainTileCatalog::FTerrainTileCatalog(const TArray<FTerrainTileDefinition>& TileDefinitions, const FTerrainMacroTileSettings& MacroTileSettings)
 {
-	int SocketIndex = Index.X;
-	int ShapeIndex = Index.Y;
-	int FaceIndex = Index.Z;
-
-	if (SuperPositions.IsValidIndex(SocketIndex) && SuperPositions[SocketIndex].IsValidIndex(ShapeIndex) && SuperPositions[SocketIndex][ShapeIndex].IsValidIndex(FaceIndex) && SuperPositions[SocketIndex][ShapeIndex][FaceIndex])
+	for (int SpawnableTileIndex = 0; SpawnableTileIndex < TileDefinitions.Num(); SpawnableTileIndex++)
 	{
-		FTerrainShape NewShape;
+		const FTerrainTileDefinition& TileData = TileDefinitions[SpawnableTileIndex];
+		VariantWeights.Emplace(TileData.SpawnWeight);
+
+		//Group with an earlier tile of the same geometry
+		int SolverTileIndex = TileVariants.IndexOfByPredicate([&](const TArray<int>& Variants)
+			{
+				const FTerrainTileDefinition& VariantData = TileDefinitions[Variants[0]];
+				return VariantData.Verticies == TileData.Verticies && VariantData.FaceTypes == TileData.FaceTypes;
+			});
+
+		if (SolverTileIndex == INDEX_NONE)
+		{
+			SolverTileIndex = TileShapes.Emplace(FTerrainShape(TileData.Verticies, TileData.FaceTypes));
+			TileWeights.Emplace(0);
+			TileAreas.Emplace(TileShapes[SolverTileIndex].GetArea());
+			TileSymmetryPeriods.Emplace(TileShapes[SolverTileIndex].GetRotationalPeriod());
+			TileVariants.Emplace(TArray<int>());
+			TileMembers.Emplace(TArray<FTerrainMacroTileMember>());
+			MaxTileVertices = FMath::Max(TileData.Verticies.Num(), MaxTileVertices);
+		}
+
+		TileWeights[SolverTileIndex] += TileData.SpawnWeight;
+		TileVariants[SolverTileIndex].Emplace(SpawnableTileIndex);
+		SolverTileIndices.Emplace(SolverTileIndex);
+	}
+
+	//The corners of macro tiles are made of the corners of single tiles, so only the single tiles fill gaps.
+	NumBaseTiles = TileShapes.Num();
+	AngleTable = FTerrainAngleTable(TileShapes);
+
+	if (NumBaseTiles > 0)
+	{
+		AssembleMacroTileGroups(MacroTileSettings);
+	}
+}
+
+/**
+ * Finds a catalog already compiled from the same tiles and settings, so that restarted and repeated generations do not sample the clusters again.
+ *
+ * @param TileDefinitions - The definitions of the spawnable tiles.
+ * @param MacroTileSettings - How the macro tiles are found.
+ * @return The compiled catalog, or null if none has been compiled from them recently.
+ */
+TSharedPtr<const FTerrainTileCatalog, ESPMode::ThreadSafe> FTerrainTileCatalog::FindCompiled(const TArray<FTerrainTileDefinition>& TileDefinitions, const FTerrainMacroTileSettings& MacroTileSettings)
+{
+	const uint32 Hash = GetTileCatalogHash(TileDefinitions, MacroTileSettings);
+
+	FScopeLock CompiledTileCatalogsScopeLock(&CompiledTileCatalogsLock);
+	const FCompiledTileCatalog* CompiledCatalog = CompiledTileCatalogs.FindByPredicate([&](const FCompiledTileCatalog& EachCompiledCatalog)
+		{
+			return EachCompiledCatalog.Hash == Hash && EachCompiledCatalog.MacroTileSettings == MacroTileSettings && EachCompiledCatalog.TileDefinitions == TileDefinitions;
+		});
+	return CompiledCatalog ? CompiledCatalog->Catalog : nullptr;
+}
+
+/**
+ * Keeps a fully compiled catalog to be found by later generations. Only the most recently compiled catalogs are kept.
+ *
+ * @param TileDefinitions - The definitions of the spawnable tiles the catalog was compiled from.
+ * @param MacroTileSettings - How the catalog's macro tiles were found.
+ * @param Catalog - The compiled catalog. Its macro tiles must have been sampled.
+ */
+void FTerrainTileCatalog::AddCompiled(const TArray<FTerrainTileDefinition>& TileDefinitions, const FTerrainMacroTileSettings& MacroTileSettings, const FTerrainTileCatalog& Catalog)
+{
+	const uint32 Hash = GetTileCatalogHash(TileDefinitions, MacroTileSettings);
+
+	FScopeLock CompiledTileCatalogsScopeLock(&CompiledTileCatalogsLock);
+
+	//Another worker may have compiled the same catalog at the same time.
+	if (CompiledTileCatalogs.ContainsByPredicate([&](const FCompiledTileCatalog& EachCompiledCatalog) { return EachCompiledCatalog.Hash == Hash && EachCompiledCatalog.MacroTileSettings == MacroTileSettings && EachCompiledCatalog.TileDefinitions == TileDefinitions; }))
+	{
+		return;
+	}
+
+	if (CompiledTileCatalogs.Num() >= MaxCompiledTileCatalogs)
+	{
+		CompiledTileCatalogs.RemoveAt(0);
+	}
+	CompiledTileCatalogs.Emplace(FCompiledTileCatalog{ Hash, TileDefinitions, MacroTileSettings, MakeShared<FTerrainTileCatalog, ESPMode::ThreadSafe>(Catalog) });
+}
+
+/**
+ * Chooses which spawnable tile to place for a solver tile by weight.
+ *
+ * @param SolverTileIndex - The solver tile being placed.
+ * @param RandomStream - The random stream used to choose.
+ * @param PreferredVariant - A spawnable tile to place if it shares the solver tile's geometry.
+ * @return The index of the spawnable tile to place.
+ */
+int FTerrainTileCatalog::ChooseVariant(const int SolverTileIndex, FRandomStream& RandomStream, const int PreferredVariant) const
+{
+	const TArray<int>& Variants = TileVariants[SolverTileIndex];
+	if (Variants.Contains(PreferredVariant))
+	{
+		return PreferredVariant;
+	}
+
+	if (Variants.Num() == 1)
+	{
+		return Variants[0];
+	}
+
+	//Choose uniformly if no variant has any weight.
+	if (TileWeights[SolverTileIndex] <= 0)
+	{
+		return Variants[RandomStream.RandHelper(Variants.Num())];
+	}
+
+	float RandomSelector = RandomStream.FRandRange(0.f, TileWeights[SolverTileIndex]);
+	for (const int EachVariant : Variants)
+	{
+		RandomSelector -= VariantWeights[EachVariant];
+		if (RandomSelector <= 0)
+		{
+			return EachVariant;
+		}
+	}
+	return Variants.Last();
+}
+
+/**
+ * Grows random clusters of the single tiles until enough have been grown or the deadline passes. Once enough have been grown, adds the ones found most often as macro tiles.
+ *
+ * @param MacroTileSettings - How many clusters to keep and how large they may be. Must be the settings the catalog was compiled with.
+ * @param Deadline - When to stop growing clusters, in platform seconds. At least one cluster is always grown.
+ * @return Whether or not the macro tiles have been added.
+ */
+bool FTerrainTileCatalog::SampleMacroTiles(const FTerrainMacroTileSettings& MacroTileSettings, const double Deadline)
+{
+	if (bMacroTilesSampled || NumBaseTiles == 0 || MacroTileSettings.SampledClusters <= 0)
+	{
+		bMacroTilesSampled = true;
+		return true;
+	}
+
+	const int MaxClusterSize = FMath::Clamp(MacroTileSettings.MaxClusterSize, 2, 6);
+	const int NumberOfSamples = MacroTileSettings.SampledClusters * 64;
+	float TotalWeight = 0;
+	for (int SolverTileIndex = 0; SolverTileIndex < NumBaseTiles; SolverTileIndex++)
+	{
+		TotalWeight += FMath::Max(TileWeights[SolverTileIndex], 0.f);
+	}
+
+	//The stream carries on from the last call, so the clusters grown do not depend on how the sampling was split up.
+	const int FirstSample = NumberOfSamplesTaken;
+	for (; NumberOfSamplesTaken < NumberOfSamples; NumberOfSamplesTaken++)
+	{
+		if (NumberOfSamplesTaken > FirstSample && FPlatformTime::Seconds() >= Deadline)
+		{
+			return false;
+		}
+
+		const int ClusterSize = ClusterStream.RandRange(2, MaxClusterSize);
+		FTerrainShape ClusterShape = FTerrainShape();
+		TArray<FTerrainMacroTileMember> Members = TArray<FTerrainMacroTileMember>();
+		for (int MemberIndex = 0; MemberIndex < ClusterSize; MemberIndex++)
+		{
+			//Choose each tile by weight, as the solver would.
+			int SolverTileIndex = ClusterStream.RandHelper(NumBaseTiles);
+			if (TotalWeight > 0)
+			{
+				float RandomSelector = ClusterStream.FRandRange(0.f, TotalWeight);
+				for (SolverTileIndex = 0; SolverTileIndex < NumBaseTiles - 1; SolverTileIndex++)
+				{
+					RandomSelector -= FMath::Max(TileWeights[SolverTileIndex], 0.f);
+					if (RandomSelector <= 0)
+					{
+						break;
+					}
+				}
+			}
+
+			if (!AttachMacroTileMember(ClusterShape, Members, SolverTileIndex, INDEX_NONE, ClusterStream, 16))
+			{
+				break;
+			}
+		}
+
+		if (Members.Num() < 2)
+		{
+			continue;
+		}
+
+		TArray<int> MemberTiles = TArray<int>();
+		for (const FTerrainMacroTileMember& EachMember : Members)
+		{
+			MemberTiles.Emplace(EachMember.SolverTileIndex);
+		}
+		MemberTiles.Sort();
+
+		//Keys are hashed rather than printed, as one is made for every sample. 64 bits make it unlikely that two different clusters are ever counted together.
+		const auto MixKey = [](const uint64 Key, const uint32 Value) { return (Key ^ Value) * 0x100000001B3ull; };
+		uint64 ClusterKey = 0xCBF29CE484222325ull;
+		for (const int EachMemberTile : MemberTiles)
+		{
+			ClusterKey = MixKey(ClusterKey, EachMemberTile);
+		}
+
+		TArray<uint32> VertexKeys = TArray<uint32>();
+		VertexKeys.Reserve(ClusterShape.Num());
+		for (const FTerrainVertex& EachVertex : ClusterShape.Vertices)
+		{
+			VertexKeys.Emplace(HashCombine(GetTypeHash(EachVertex.Type), HashCombine(GetTypeHash(FMath::RoundToInt(EachVertex.Length)), GetTypeHash(FMath::RoundToInt(FMath::RadiansToDegrees(EachVertex.Angle))))));
+		}
+
+		//Start the outline at whichever vertex gives the smallest key, so that rotated copies of a cluster share a key.
+		uint64 OutlineKey = MAX_uint64;
+		for (int StartIndex = 0; StartIndex < VertexKeys.Num(); StartIndex++)
+		{
+			uint64 RotatedKey = ClusterKey;
+			for (int VertexOffset = 0; VertexOffset < VertexKeys.Num(); VertexOffset++)
+			{
+				RotatedKey = MixKey(RotatedKey, VertexKeys[(StartIndex + VertexOffset) % VertexKeys.Num()]);
+			}
+			OutlineKey = FMath::Min(OutlineKey, RotatedKey);
+		}
+
+		FSampledCluster& SampledCluster = SampledClusters.FindOrAdd(OutlineKey);
+		if (SampledCluster.Count == 0)
+		{
+			SampledCluster.Shape = ClusterShape;
+			SampledCluster.Members = Members;
+		}
+		SampledCluster.Count++;
+	}
+
+	//Keep the clusters found most often. Clusters only found once are too rare to be worth testing at every socket.
+	TArray<FSampledCluster> FrequentClusters = TArray<FSampledCluster>();
+	for (TPair<uint64, FSampledCluster>& EachSampledCluster : SampledClusters)
+	{
+		if (EachSampledCluster.Value.Count > 1)
+		{
+			FrequentClusters.Emplace(MoveTemp(EachSampledCluster.Value));
+		}
+	}
+	FrequentClusters.StableSort([](const FSampledCluster& A, const FSampledCluster& B) { return A.Count > B.Count; });
+
+	//Weigh each cluster by how often it was found relative to the most common one, so that the most common cluster has the same weight as a group with the default spawn weight.
+	for (int ClusterIndex = 0; ClusterIndex < FMath::Min(FrequentClusters.Num(), MacroTileSettings.SampledClusters); ClusterIndex++)
+	{
+		AddMacroTile(FrequentClusters[ClusterIndex].Shape, FrequentClusters[ClusterIndex].Members, (float)FrequentClusters[ClusterIndex].Count / FrequentClusters[0].Count);
+	}
+
+	SampledClusters.Empty();
+	bMacroTilesSampled = true;
+	return true;
+}
+
+/**
+ * Fits together the tiles of each user defined group and adds them as macro tiles.
+ *
+ * @param MacroTileSettings - The groups to fit together.
+ */
+void FTerrainTileCatalog::AssembleMacroTileGroups(const FTerrainMacroTileSettings& MacroTileSettings)
+{
+	for (int GroupIndex = 0; GroupIndex < MacroTileSettings.Groups.Num(); GroupIndex++)
+	{
+		const FTerrainMacroTileGroup& Group = MacroTileSettings.Groups[GroupIndex];
+		if (Group.TileIndices.Num() < 2 || Group.TileIndices.ContainsByPredicate([&](const int TileIndex) { return !SolverTileIndices.IsValidIndex(TileIndex); }))
+		{
+			UE_LOG(LogTerrainTool, Warning, TEXT("Macro tile group %i must have at least two valid spawnable tile indices"), GroupIndex);
+			continue;
+		}
+
+		//Try a few different fits, as an early tile may be attached where a later one cannot fit.
+		FRandomStream GroupStream = FRandomStream(GroupIndex);
+		bool bAssembled = false;
+		for (int Attempt = 0; Attempt < 16 && !bAssembled; Attempt++)
+		{
+			FTerrainShape ClusterShape = FTerrainShape();
+			TArray<FTerrainMacroTileMember> Members = TArray<FTerrainMacroTileMember>();
+			bAssembled = true;
+			for (const int EachTileIndex : Group.TileIndices)
+			{
+				if (!AttachMacroTileMember(ClusterShape, Members, SolverTileIndices[EachTileIndex], EachTileIndex, GroupStream, 0))
+				{
+					bAssembled = false;
+					break;
+				}
+			}
+
+			if (bAssembled)
+			{
+				AddMacroTile(ClusterShape, Members, Group.SpawnWeight);
+			}
+		}
+
+		if (!bAssembled)
+		{
+			UE_LOG(LogTerrainTool, Warning, TEXT("The tiles of macro tile group %i do not fit together"), GroupIndex);
+		}
+	}
+}
+
+/**
+ * Attaches a single tile to a face of a cluster, leaving only gaps the single tiles can fill.
+ *
+ * @param ClusterShape - The outline of the cluster. Set to the merged outline if the tile was attached.
+ * @param Members - The tiles of the cluster. The new tile is added if it was attached.
+ * @param SolverTileIndex - The single tile to attach.
+ * @param PreferredVariant - The spawnable tile to place for the new member, or INDEX_NONE if any variant may be placed.
+ * @param RandomStream - The random stream used to choose where to attach the tile.
+ * @param MaxAttempts - The most faces to try. Every face is tried if 0.
+ * @return Whether or not the tile was attached.
+ */
+bool FTerrainTileCatalog::AttachMacroTileMember(FTerrainShape& ClusterShape, TArray<FTerrainMacroTileMember>& Members, const int SolverTileIndex, const int PreferredVariant, FRandomStream& RandomStream, const int MaxAttempts) const
+{
+	const FTerrainShape& TileShape = TileShapes[SolverTileIndex];
+	const int SymmetryPeriod = TileSymmetryPeriods[SolverTileIndex];
+	if (ClusterShape.Num() == 0)
+	{
+		ClusterShape = TileShape;
+		Members.Emplace(FTerrainMacroTileMember{ SolverTileIndex, PreferredVariant, FTransform2D() });
+		return true;
+	}
+
+	//Try random faces, or every face once from a random start when there is no limit.
+	const int NumberOfFaces = ClusterShape.Num() * SymmetryPeriod;
+	const int FirstFace = RandomStream.RandHelper(NumberOfFaces);
+	for (int Attempt = 0; Attempt < (MaxAttempts > 0 ? FMath::Min(MaxAttempts, NumberOfFaces) : NumberOfFaces); Attempt++)
+	{
+		const int Face = MaxAttempts > 0 ? RandomStream.RandHelper(NumberOfFaces) : (FirstFace + Attempt) % NumberOfFaces;
+		FTerrainShape MergedShape;
 		FTerrainShapeMergeResult MergeResult;
+		if (!ClusterShape.MergeShape(MergedShape, MergeResult, Face / SymmetryPeriod, TileShape, Face % SymmetryPeriod) || MergedShape.Num() < 3)
+		{
+			continue;
+		}
+
+		//The cluster is placed as one, so every corner of its outline must still be fillable.
+		if (MergedShape.Vertices.ContainsByPredicate([&](const FTerrainVertex& Vertex) { return !AngleTable.IsFillable(Vertex.Angle); }))
+		{
+			continue;
+		}
+
+		ClusterShape = MergedShape;
+		Members.Emplace(FTerrainMacroTileMember{ SolverTileIndex, PreferredVariant, MergeResult.Transform });
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Adds a cluster of single tiles as a macro tile.
+ *
+ * @param ClusterShape - The outline of the cluster.
+ * @param Members - The tiles of the cluster.
+ * @param Weight - How likely the macro tile is to spawn relative to the other macro tiles.
+ */
+void FTerrainTileCatalog::AddMacroTile(const FTerrainShape& ClusterShape, const TArray<FTerrainMacroTileMember>& Members, const float Weight)
+{
+	TileShapes.Emplace(ClusterShape);
+	TileWeights.Emplace(Weight);
+	TileSymmetryPeriods.Emplace(ClusterShape.GetRotationalPeriod());
+	TileVariants.Emplace(TArray<int>());
+	TileMembers.Emplace(Members);
+
+	double Area = 0;
+	for (const FTerrainMacroTileMember& EachMember : Members)
+	{
+		Area += TileAreas[EachMember.SolverTileIndex];
+	}
+	TileAreas.Emplace(Area);
+}
+
+/* /\ ===================== /\ *\
+|  /\ FTerrainTileCatalog  /\  |
+\* /\ ===================== /\ */
+
+
+
+/* \/ ========================== \/ *\
+|  \/ FTerrainSocketCandidates  \/  |
+\* \/ ========================== \/ */
+
+/**
+ * Rebuilds the candidates and alias table from the superpositions of a socket. Only keeps the macro tiles if any of them fit. Reuses the existing allocations.
+ *
+ * @param SocketSuperPositions - The superposition states of the socket. Indexed by solver tile, then face.
+ * @param TileCatalog - The solver tiles that can be spawned.
+ */
+void FTerrainSocketCandidates::Rebuild(const TArray<TArray<bool>>& SocketSuperPositions, const FTerrainTileCatalog& TileCatalog)
+{
+	Candidates.Reset();
+	Probabilities.Reset();
+	Aliases.Reset();
+
+	//Macro tiles are placed wherever one fits, so single tiles are only kept to close the gaps between them.
+	int FirstShapeIndex = 0;
+	for (int ShapeIndex = TileCatalog.NumBaseTiles; ShapeIndex < SocketSuperPositions.Num() && FirstShapeIndex == 0; ShapeIndex++)
+	{
+		if (SocketSuperPositions[ShapeIndex].Contains(true))
+		{
+			FirstShapeIndex = TileCatalog.NumBaseTiles;
+		}
+	}
+
+	//Each candidate gets an equal share of its solver tile's weight.
+	float TotalWeight = 0;
+	for (int ShapeIndex = FirstShapeIndex; ShapeIndex < SocketSuperPositions.Num(); ShapeIndex++)
+	{
+		const int FirstCandidate = Candidates.Num();
+		for (int FaceIndex = 0; FaceIndex < SocketSuperPositions[ShapeIndex].Num(); FaceIndex++)
+		{
+			if (SocketSuperPositions[ShapeIndex][FaceIndex])
+			{
+				Candidates.Emplace(ShapeIndex, FaceIndex);
+			}
+		}
+
+		const int NumberOfFaces = Candidates.Num() - FirstCandidate;
+		for (int FaceIndex = 0; FaceIndex < NumberOfFaces; FaceIndex++)
+		{
+			Probabilities.Emplace(FMath::Max(TileCatalog.TileWeights[ShapeIndex], 0.f) / NumberOfFaces);
+		}
+		TotalWeight += NumberOfFaces > 0 ? FMath::Max(TileCatalog.TileWeights[ShapeIndex], 0.f) : 0;
+	}
+
+	if (Candidates.IsEmpty())
+	{
+		return;
+	}
+
+	//Choose uniformly if no candidate has any weight.
+	Aliases.Init(0, Candidates.Num());
+	for (int CandidateIndex = 0; CandidateIndex < Candidates.Num(); CandidateIndex++)
+	{
+		Aliases[CandidateIndex] = CandidateIndex;
+		Probabilities[CandidateIndex] = TotalWeight > 0 ? Probabilities[CandidateIndex] * Candidates.Num() / TotalWeight : 1;
+	}
+
+	//Vose's method. Pair each column with less than its share with a column with more than its share.
+	TArray<int, TInlineAllocator<32>> Small = TArray<int, TInlineAllocator<32>>();
+	TArray<int, TInlineAllocator<32>> Large = TArray<int, TInlineAllocator<32>>();
+	for (int CandidateIndex = 0; CandidateIndex < Candidates.Num(); CandidateIndex++)
+	{
+		(Probabilities[CandidateIndex] < 1 ? Small : Large).Emplace(CandidateIndex);
+	}
+
+	while (!Small.IsEmpty() && !Large.IsEmpty())
+	{
+		const int SmallIndex = Small.Pop(false);
+		const int LargeIndex = Large.Pop(false);
+		Aliases[SmallIndex] = LargeIndex;
+		Probabilities[LargeIndex] += Probabilities[SmallIndex] - 1;
+		(Probabilities[LargeIndex] < 1 ? Small : Large).Emplace(LargeIndex);
+	}
+
+	//Anything left over only differs from its share by rounding error.
+	for (const int EachIndex : Small)
+	{
+		Probabilities[EachIndex] = 1;
+	}
+	for (const int EachIndex : Large)
+	{
+		Probabilities[EachIndex] = 1;
+	}
+}
+
+/* /\ ========================== /\ *\
+|  /\ FTerrainSocketCandidates  /\  |
+\* /\ ========================== /\ */
+
+
+
+/* \/ ========================= \/ *\
+|  \/ FTerrainCollapseContext  \/  |
+\* \/ ========================= \/ */
+
+/**
+ * Finds the active socket whose midpoint is closest to a location.
+ *
+ * @param Location - The location to search from, in terrain space.
+ * @param OutDistanceSquared - Set to the squared distance between the location and the closest socket.
+ * @return The index of the closest socket, or INDEX_NONE if the terrain has no active sockets.
+ */
+int FTerrainCollapseContext::FindClosestSocket(const FVector2D Location, float& OutDistanceSquared) const
+{
+	int ClosestSocketIndex = INDEX_NONE;
+	OutDistanceSquared = MAX_FLT;
+	for (const int SearchIndex : ActiveSockets)
+	{
+		const float SearchDistanceSquared = FVector2D::DistSquared(GetSocketLocation(SearchIndex), Location);
+		if (SearchDistanceSquared < OutDistanceSquared)
+		{
+			OutDistanceSquared = SearchDistanceSquared;
+			ClosestSocketIndex = SearchIndex;
+		}
+	}
+	return ClosestSocketIndex;
+}
+
+/**
+ * Determines whether collapsing a socket cannot change the superpositions of any of the given collapses, so that they can all be made before the next refresh.
+ *
+ * @param SocketIndex - The socket to check.
+ * @param Collapses - The collapses already chosen.
+ * @return Whether or not the vertices the socket's merges depend on are disjoint from those of every chosen collapse.
+ */
+bool FTerrainCollapseContext::IsIndependentOf(const int SocketIndex, const TArray<FIntVector>& Collapses) const
+{
+	const FTerrainSocketCandidates& Candidates = SocketCandidates[SocketIndex];
+	for (const FIntVector& EachCollapse : Collapses)
+	{
+		const FTerrainSocketCandidates& CollapseCandidates = SocketCandidates[EachCollapse.X];
+		const int SeparationAfter = UPTTMath::Mod(SocketIndex - EachCollapse.X, Shape.Num());
+		const int SeparationBefore = Shape.Num() - SeparationAfter;
+		if (SeparationAfter <= CollapseCandidates.ReachAfter + Candidates.ReachBefore || SeparationBefore <= CollapseCandidates.ReachBefore + Candidates.ReachAfter)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/* /\ ========================= /\ *\
+|  /\ FTerrainCollapseContext  /\  |
+\* /\ ========================= /\ */
+
+
+
+/* \/ ========================= \/ *\
+|  \/ FTerrainGenerationWorker  \/  |
+\* \/ ========================= \/ */
+
+/**
+ * Queues a command to be carried out after the commands already queued. Must only be called from one thread.
+ *
+ * @param Command - The command to carry out.
+ */
+void FTerrainGenerationWorker::EnqueueCommand(const FTerrainGenerationCommand& Command)
+{
+	PendingCommands++;
+	Commands.Enqueue(Command);
+
+	if (bUseScheduler && !bScheduled.exchange(true))
+	{
+		FTerrainGenerationScheduler::Get().Schedule(this);
+	}
+}
+
+/**
+ * Determines whether this was created with the given config.
+ *
+ * @param SolverConfig - The config to compare against.
+ * @param bShouldUseScheduler - Whether or not the new commands should be run by the scheduler.
+ * @return Whether or not new commands for this config can be given to this.
+ */
+bool FTerrainGenerationWorker::CanContinueWith(const FTerrainSolverConfig& SolverConfig, const bool bShouldUseScheduler) const
+{
+	return Config == SolverConfig && bUseScheduler == bShouldUseScheduler;
+}
+
+/**
+ * Determines whether this is run by the scheduler rather than by its owner calling RunSlice.
+ *
+ * @return Whether or not this is run by the scheduler.
+ */
+bool FTerrainGenerationWorker::UsesScheduler() const
+{
+	return bUseScheduler;
+}
+
+/**
+ * Determines whether the mode being run is paused.
+ *
+ * @return Whether or not the mode being run is paused.
+ */
+bool FTerrainGenerationWorker::IsPaused() const
+{
+	return bPaused;
+}
+
+/**
+ * Sets how much solver time this gets relative to other workers.
+ *
+ * @param NewPriority - The multiplier applied to the scheduler's time slice.
+ */
+void FTerrainGenerationWorker::SetPriority(const float NewPriority)
+{
+	Priority = FMath::Max(NewPriority, 0.1f);
+}
+
+/**
+ * Determines whether the terrain is finished generating, meaning every queued command has been carried out.
+ *
+ * @return Whether or not the terrain is finished generating.
+ */
+bool FTerrainGenerationWorker::IsTerrainFinishedGenerating() const
+{
+	//Pending commands are read first as a mode is always marked as running before its command stops being pending.
+	return PendingCommands == 0 && !bRunning;
+}
+
+/**
+ * Gets the most recently published shape of the terrain without copying it.
+ *
+ * @return An immutable snapshot of the shape of the terrain.
+ */
+FTerrainShapeSnapshot FTerrainGenerationWorker::GetTerrainShapeSnapshot() const
+{
+	FScopeLock SnapshotScopeLock(&ShapeSnapshotLock);
+	return ShapeSnapshot;
+}
+
+/**
+ * Moves the results of the superposition collapses made since the last call into the given array. Must only be called from one thread.
+ *
+ * @param OutTiles - Will have the new results appended to it.
+ * @return The number of new results.
+ */
+int FTerrainGenerationWorker::DequeueTerrainTiles(TArray<FTerrainTileInstanceData>& OutTiles)
+{
+	const int InitialNum = OutTiles.Num();
+
+	FTerrainTileInstanceData NewTile;
+	while (NewTerrainTiles.Dequeue(NewTile))
+	{
+		OutTiles.Emplace(NewTile);
+	}
+	return OutTiles.Num() - InitialNum;
+}
+
+/**
+ * Takes the location of the oldest error reported since the last call. Must only be called from one thread.
+ *
+ * @param OutLocation - Set to the location of the error, in world space.
+ * @return Whether or not there was an error to take.
+ */
+bool FTerrainGenerationWorker::DequeueErrorLocation(FVector& OutLocation)
+{
+	return NewErrorLocations.Dequeue(OutLocation);
+}
+
+/**
+ * Gets the random stream used to generate the terrain. Only safe to call once nothing is running this.
+ *
+ * @return The random stream in its current state.
+ */
+FRandomStream FTerrainGenerationWorker::GetRandomStream() const
+{
+	return Config.bCounterBasedRandom ? SeedStream : RandomStream;
+}
+
+/**
+ * Gets how quickly the terrain is being filled.
+ *
+ * @return A snapshot of the generation progress.
+ */
+FTerrainGenerationProgress FTerrainGenerationWorker::GetProgress() const
+{
+	const double CurrentTime = FPlatformTime::Seconds();
+
+	FTerrainGenerationProgress Progress = FTerrainGenerationProgress();
+	Progress.TilesPlaced = TilesPlaced;
+	Progress.AreaFilled = AreaFilled;
+	Progress.ElapsedTime = CurrentTime - StartTime;
+	Progress.TimeSinceLastCollapse = CurrentTime - LastCollapseTime;
+	Progress.LastStepLookaheadNodes = LastRefreshLookaheadNodes;
+	Progress.PeakStepLookaheadNodes = PeakRefreshLookaheadNodes;
+	Progress.Steps = StepsRun;
+	Progress.LastStepFrontierLength = LastStepFrontierLength;
+	Progress.LastStepActiveFrontierLength = LastStepActiveFrontierLength;
+	Progress.PeakStepFrontierLength = PeakStepFrontierLength;
+	Progress.TotalStepFrontierLength = TotalStepFrontierLength;
+	return Progress;
+}
+
+/**
+ * Creates a FTerrainGenerationWorker able to compute superposition collapses of the given tiles.
+ *
+ * @param SolverConfig - The tiles and settings that will be used to generate the terrain.
+ * @param GenerationStream - The random stream to start generating with. Copied so that the worker owns its stream.
+ * @param UpdateDelegate - Executed on the game thread when there are new tiles or generation has finished.
+ * @param CurrentTerrainShape - The shape of the terrain to continue generating from.
+ * @param bRunOnScheduler - Whether to be run by the scheduler. Otherwise the owner must call RunSlice itself.
+ */
+FTerrainGenerationWorker::FTerrainGenerationWorker(const FTerrainSolverConfig& SolverConfig, const FRandomStream& GenerationStream, FSimpleDelegate UpdateDelegate, FTerrainShape CurrentTerrainShape, const bool bRunOnScheduler) :
+	bStopped(false),
+	OnUpdate(UpdateDelegate),
+	bUpdatePending(false),
+	PendingCommands(0),
+	bUseScheduler(bRunOnScheduler),
+	bScheduled(false),
+	ReleasedEvent(FPlatformProcess::GetSynchEventFromPool(true)),
+	Priority(1),
+	InitializationPhase(ETerrainInitializationPhase::CompileTiles),
+	NextInitialSocket(0),
+	InitialRefreshBatchSize(FMath::Max(CVarTerrainParallelRefreshSockets.GetValueOnAnyThread(), 1)),
+	RunningMode(nullptr),
+	bRunning(false),
+	bPaused(false),
+	CollapseMode(nullptr),
+	RequiredTileIndex(INDEX_NONE),
+	RandomStream(GenerationStream),
+	SeedStream(GenerationStream),
+	CounterKey(0),
+	DecisionIndex(0),
+	Config(SolverConfig),
+	Shape(CurrentTerrainShape),
+	LastSnapshotTime(0),
+	bMergesPending(false),
+	ThawingSocket(INDEX_NONE),
+	FrozenSocketsAfterCompaction(0),
+	StartTime(FPlatformTime::Seconds()),
+	LastCollapseTime(FPlatformTime::Seconds()),
+	TilesPlaced(0),
+	AreaFilled(0),
+	LookaheadNodes(0),
+	LastRefreshLookaheadNodes(0),
+	PeakRefreshLookaheadNodes(0),
+	StepsRun(0),
+	LastStepFrontierLength(0),
+	LastStepActiveFrontierLength(0),
+	PeakStepFrontierLength(0),
+	TotalStepFrontierLength(0)
+{ 
+	//The tiles are compiled and the superpositions built in the first slice.
+	SuperPositions = TArray<TArray<TArray<bool>>>();
+	PublishShapeSnapshot();
+	ReleasedEvent->Trigger();
+
+	//Drawing the key advances the seed, so that the next worker made from it gets a different key.
+	if (Config.bCounterBasedRandom)
+	{
+		CounterKey = SeedStream.GetUnsignedInt();
+	}
+
+	if (bUseScheduler)
+	{
+		bScheduled = true;
+		FTerrainGenerationScheduler::Get().Schedule(this);
+	}
+}
+
+/**
+ * Stops and unschedules this.
+ */
+FTerrainGenerationWorker::~FTerrainGenerationWorker()
+{ 
+	Stop();
+	WaitForCompletion();
+
+	FPlatformProcess::ReturnSynchEventToPool(ReleasedEvent);
+	ReleasedEvent = nullptr;
+}
+
+/**
+ * Compiles the tiles and builds the initial superpositions, picking up where the last slice left off. Stops between phases and batches once the slice is used up or this is stopped.
+ *
+ * @param SliceEnd - When the slice ends, in platform seconds. Every call makes some progress.
+ * @return Whether or not initialization is done.
+ */
+bool FTerrainGenerationWorker::Initialize(const double SliceEnd)
+{
+	//Cancellation point between phases. Nothing built from here on is used once stopped.
+	while (InitializationPhase != ETerrainInitializationPhase::Done && !bStopped)
+	{
+		switch (InitializationPhase)
+		{
+		case ETerrainInitializationPhase::CompileTiles:
+		{
+			//Set up generation constants. A restarted or repeated generation copies the catalog compiled by an earlier one rather than sampling the clusters again.
+			const TSharedPtr<const FTerrainTileCatalog, ESPMode::ThreadSafe> CompiledCatalog = FTerrainTileCatalog::FindCompiled(Config.Tiles, Config.MacroTiles);
+			TileCatalog = CompiledCatalog ? *CompiledCatalog : FTerrainTileCatalog(Config.Tiles, Config.MacroTiles);
+			InitializationPhase = ETerrainInitializationPhase::SampleMacroTiles;
+			break;
+		}
+
+		case ETerrainInitializationPhase::SampleMacroTiles:
+			if (!TileCatalog.SampleMacroTiles(Config.MacroTiles, SliceEnd))
+			{
+				return false;
+			}
+
+			//Does nothing if the catalog was copied from an earlier one.
+			FTerrainTileCatalog::AddCompiled(Config.Tiles, Config.MacroTiles, TileCatalog);
+
+			if (TileCatalog.Num() > TileCatalog.NumBaseTiles)
+			{
+				UE_LOG(LogTerrainTool, Log, TEXT("Compiled %i macro tiles"), TileCatalog.Num() - TileCatalog.NumBaseTiles);
+			}
+			InitializationPhase = ETerrainInitializationPhase::BuildSuperPositions;
+			break;
+
+		case ETerrainInitializationPhase::BuildSuperPositions:
+			BaseSuperPositions = TArray<TArray<bool>>();
+			for (int SolverTileIndex = 0; SolverTileIndex < TileCatalog.Num(); SolverTileIndex++)
+			{
+				TArray<bool> Faces = TArray<bool>();
+				Faces.Init(false, TileCatalog.TileShapes[SolverTileIndex].Num());
+				for (int FaceIndex = 0; FaceIndex < TileCatalog.TileSymmetryPeriods[SolverTileIndex]; FaceIndex++)
+				{
+					Faces[FaceIndex] = true;
+				}
+				BaseSuperPositions.Emplace(Faces);
+			}
+
+			if (Shape.Num() == 0)
+			{
+				SuperPositions.Emplace(BaseSuperPositions);
+				SocketCandidates.AddDefaulted_GetRef().Rebuild(BaseSuperPositions, TileCatalog);
+				InitializationPhase = ETerrainInitializationPhase::Done;
+			}
+			else
+			{
+				NextInitialSocket = 0;
+				InitializationPhase = ETerrainInitializationPhase::RefreshFrontier;
+			}
+			break;
+
+		case ETerrainInitializationPhase::RefreshFrontier:
+		{
+			//A resumed frontier is refreshed a batch at a time. The shape does not change until it is done, so each batch is the same as the matching part of a single full pass.
+			const double BatchStart = FPlatformTime::Seconds();
+			const int BatchSize = FMath::Min(InitialRefreshBatchSize, Shape.Num() - NextInitialSocket);
+			bMergesPending = true;
+			if (NextInitialSocket == 0)
+			{
+				//The first batch fills in the superpositions of the sockets that have not been refreshed yet.
+				PendingSourceSockets.Init(INDEX_NONE, Shape.Num());
+				PendingMovedSockets.Reset();
+			}
+			else
+			{
+				for (int SocketIndex = 0; SocketIndex < Shape.Num(); SocketIndex++)
+				{
+					PendingSourceSockets[SocketIndex] = SocketIndex;
+				}
+				PendingMovedSockets = PendingSourceSockets;
+			}
+			PendingStaleSockets.Init(false, Shape.Num());
+			PendingStaleSockets.SetRange(NextInitialSocket, BatchSize, true);
+			RefreshSuperPositions();
+
+			//Stopping during a batch leaves the superpositions incomplete, but Run will not use them.
+			if (bStopped)
+			{
+				return false;
+			}
+
+			NextInitialSocket += BatchSize;
+			if (NextInitialSocket >= Shape.Num())
+			{
+				InitializationPhase = ETerrainInitializationPhase::Done;
+				break;
+			}
+
+			//Size the next batch by how long this one took per socket, so that it fits in what is left of the slice or a whole slice.
+			const double Now = FPlatformTime::Seconds();
+			const double SecondsPerSocket = FMath::Max((Now - BatchStart) / BatchSize, 1e-7);
+			const double BatchDuration = Now < SliceEnd ? SliceEnd - Now : SliceEnd - BatchStart;
+			InitialRefreshBatchSize = FMath::Clamp((int)(BatchDuration / SecondsPerSocket), 1, Shape.Num());
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		if (InitializationPhase != ETerrainInitializationPhase::Done && FPlatformTime::Seconds() >= SliceEnd)
+		{
+			return false;
+		}
+	}
+
+	return InitializationPhase == ETerrainInitializationPhase::Done;
+}
+
+/**
+ * Carries out queued commands and runs the current mode until there is nothing left to do or the slice is used up.
+ *
+ * @param SliceDuration - How long to run for, in seconds. At least one step is always taken.
+ * @return Whether or not there is still work to do.
+ */
+bool FTerrainGenerationWorker::RunSlice(const double SliceDuration)
+{ 
+	const double SliceEnd = FPlatformTime::Seconds() + SliceDuration;
+
+	//Initialization is spread over as many slices as it needs, and nothing else runs until it is done.
+	if (InitializationPhase != ETerrainInitializationPhase::Done && !Initialize(SliceEnd))
+	{
+		return HasWork();
+	}
+
+	do
+	{
+		ProcessCommands();
+
+		if (bRunning && !bPaused && !bStopped && !RunModeStep())
+		{
+			//Publish the final shape before reporting that the mode is done.
+			RunningMode = nullptr;
+			PublishShapeSnapshot();
+			bRunning = false;
+			NotifyUpdate();
+
+			UE_LOG(LogTerrainTool, Log, TEXT("---- Super Position Collapse Ended ----"));
+		}
+	}
+	while (HasWork() && FPlatformTime::Seconds() < SliceEnd);
+
+	return HasWork();
+}
+
+/**
+ * Determines whether initialization, commands or an unpaused mode are waiting to be run.
+ *
+ * @return Whether or not this needs more time.
+ */
+bool FTerrainGenerationWorker::HasWork() const
+{
+	return !bStopped && (InitializationPhase != ETerrainInitializationPhase::Done || PendingCommands > 0 || (bRunning && !bPaused));
+}
+
+/**
+ * Stops the generation process regardless of completion.
+ */
+void FTerrainGenerationWorker::Stop()
+{ 
+	bStopped = true;
+}
+
+/**
+ * Blocks until no scheduler thread is running this and publishes the final shape. Returns within a few milliseconds of Stop being called.
+ */
+void FTerrainGenerationWorker::WaitForCompletion()
+{
+	if (bUseScheduler)
+	{
+		//Released straight away if this is only waiting, otherwise once the current slice ends. A scheduler that has shut down has already released it.
+		if (FTerrainGenerationScheduler::IsAvailable())
+		{
+			FTerrainGenerationScheduler::Get().Unschedule(this);
+		}
+		ReleasedEvent->Wait();
+	}
+
+	//Nothing else is using this anymore.
+	PublishShapeSnapshot();
+}
+
+/**
+ * Acknowledges the latest update so that the next new tile or completion sends a new notification.
+ */
+void FTerrainGenerationWorker::AcknowledgeUpdate()
+{
+	bUpdatePending = false;
+}
+
+/**
+ * Notifies the game thread that there are new tiles or that generation has finished. Only one notification is in flight at a time.
+ */
+void FTerrainGenerationWorker::NotifyUpdate()
+{
+	if (!bUpdatePending.exchange(true))
+	{
+		AsyncTask(ENamedThreads::GameThread, [UpdateDelegate = OnUpdate]()
+			{
+				UpdateDelegate.ExecuteIfBound();
+			});
+	}
+}
+
+/**
+ * Publishes an immutable copy of the current shape of the terrain.
+ */
+void FTerrainGenerationWorker::PublishShapeSnapshot()
+{
+	FTerrainShapeSnapshot NewSnapshot = MakeShared<FTerrainShape, ESPMode::ThreadSafe>(GetExpandedShape());
+	LastSnapshotTime = FPlatformTime::Seconds();
+
+	FScopeLock SnapshotScopeLock(&ShapeSnapshotLock);
+	ShapeSnapshot = NewSnapshot;
+}
+
+/**
+ * Gets the current shape of the terrain with every frozen span put back.
+ *
+ * @return The whole shape of the terrain.
+ */
+FTerrainShape FTerrainGenerationWorker::GetExpandedShape() const
+{
+	if (FrozenSpans.IsEmpty())
+	{
+		return Shape;
+	}
+
+	TArray<int> SpanOrder = TArray<int>();
+	int NumberOfVertices = Shape.Num();
+	for (int SpanIndex = 0; SpanIndex < FrozenSpans.Num(); SpanIndex++)
+	{
+		SpanOrder.Emplace(SpanIndex);
+		NumberOfVertices += FrozenSpans[SpanIndex].Vertices.Num();
+	}
+	SpanOrder.Sort([this](const int A, const int B) { return FrozenSpans[A].SocketIndex < FrozenSpans[B].SocketIndex; });
+
+	FTerrainShape ExpandedShape = FTerrainShape();
+	ExpandedShape.Vertices.Reserve(NumberOfVertices);
+	int NextSpan = 0;
+	for (int VertexIndex = 0; VertexIndex < Shape.Num(); VertexIndex++)
+	{
+		ExpandedShape.Vertices.Emplace(Shape.Vertices[VertexIndex]);
+		if (SpanOrder.IsValidIndex(NextSpan) && FrozenSpans[SpanOrder[NextSpan]].SocketIndex == VertexIndex)
+		{
+			const FTerrainFrozenSpan& Span = FrozenSpans[SpanOrder[NextSpan]];
+			ExpandedShape.Vertices.Last().Type = Span.SocketType;
+			ExpandedShape.Vertices.Append(Span.Vertices);
+			NextSpan++;
+		}
+	}
+	return ExpandedShape;
+}
+
+/**
+ * Starts a new step of random decisions. When generating with a counter-based random, reseeds the random stream from the counter key and the step's index.
+ */
+void FTerrainGenerationWorker::BeginDecision()
+{
+	if (Config.bCounterBasedRandom)
+	{
+		RandomStream.Initialize((int32)UPTTMath::Philox(CounterKey, DecisionIndex));
+	}
+	DecisionIndex++;
+}
+
+/**
+ * Reports an error to the game thread.
+ *
+ * @param Location - The location of the error, in world space.
+ */
+void FTerrainGenerationWorker::ReportError(const FVector Location)
+{
+	NewErrorLocations.Enqueue(Location);
+	NotifyUpdate();
+}
+
+/**
+ * Gets the midpoint of a socket in world space.
+ *
+ * @param SocketIndex - The socket to locate.
+ * @return The location of the socket, in world space.
+ */
+FVector FTerrainGenerationWorker::GetSocketLocation(const int SocketIndex) const
+{
+	const FVector LocalLocation = FVector((Shape.Vertices[SocketIndex].Location + Shape.Vertices[(SocketIndex + 1) % Shape.Num()].Location) / 2, 0);
+	return CollapseMode.IsValid() ? CollapseMode->TerrainTransform.TransformPosition(LocalLocation) : LocalLocation;
+}
+
+/**
+ * Carries out every queued command.
+ */
+void FTerrainGenerationWorker::ProcessCommands()
+{
+	FTerrainGenerationCommand Command;
+	while (!bStopped && Commands.Dequeue(Command))
+	{
+		switch (Command.Type)
+		{
+		case ETerrainGenerationCommandType::RunMode:
+			//A new mode replaces the one being run and continues from the current shape.
+			RunningMode = Command.Mode;
+			bRunning = RunningMode.IsValid();
+			bPaused = false;
+			StartTime = FPlatformTime::Seconds();
+			LastCollapseTime = StartTime.load();
+			TilesPlaced = 0;
+			AreaFilled = 0;
+			StepsRun = 0;
+			PeakStepFrontierLength = 0;
+			TotalStepFrontierLength = 0;
+
+			UE_LOG(LogTerrainTool, Log, TEXT("--- Super Position Collapse Started ---"));
+			break;
+
+		case ETerrainGenerationCommandType::PlaceTile:
+			CollapseMode = Command.Mode;
+			RequiredTileIndex = Command.TileIndex;
+			PlaceTileAt(Command.Location, Command.TileIndex);
+			PublishShapeSnapshot();
+			break;
+
+		case ETerrainGenerationCommandType::Pause:
+			bPaused = true;
+			break;
+
+		case ETerrainGenerationCommandType::Resume:
+			//Time spent paused does not count towards stalling.
+			bPaused = false;
+			LastCollapseTime = FPlatformTime::Seconds();
+			break;
+		}
+
+		PendingCommands--;
+		NotifyUpdate();
+	}
+}
+
+/**
+ * Collapses the superposition chosen by the running mode.
+ *
+ * @return Whether or not the running mode needs another collapse.
+ */
+bool FTerrainGenerationWorker::RunModeStep()
+{
+	if (SuperPositions.IsEmpty())
+	{
+		return false;
+	}
+
+	CollapseMode = RunningMode;
+	RequiredTileIndex = RunningMode->GetRequiredTileIndex();
+
+	//Freeze the sockets this mode will never collapse.
+	if (FrozenBounds != RunningMode)
+	{
+		SetFrozenBounds(RunningMode);
+	}
+
+	//Take long runs of frozen sockets out of the shape once as many have been frozen since the last time as are active.
+	const int FrozenSocketsToCompact = CVarTerrainFrozenSocketsToCompact.GetValueOnAnyThread();
+	if (FrozenSocketsToCompact > 0 && Shape.Num() - ActiveSockets.Num() - FrozenSocketsAfterCompaction > FMath::Max(ActiveSockets.Num(), FrozenSocketsToCompact))
+	{
+		CompactFrozenSockets();
+	}
+
+	//Every socket left is outside of the mode's bounds.
+	if (ActiveSockets.IsEmpty() && Shape.Num() > 0)
+	{
+		return false;
+	}
+	BeginDecision();
+
+	TArray<FIntVector> CollapseResults = TArray<FIntVector>();
+	FVector ErrorLocation = FVector::ZeroVector;
+	const bool bNeedsMoreCollapses = CollapseMode->GetSuperPositionBatchToCollapse(CollapseResults, ErrorLocation, FTerrainCollapseContext(Shape, SuperPositions, SocketCandidates, ActiveSockets, OrderedSockets, TileCatalog), RandomStream, Config.CollapseBatchSize);
+	if (bStopped)
+	{
+		return false;
+	}
+
+	if (!ErrorLocation.IsZero())
+	{
+		ReportError(ErrorLocation);
+	}
+
+	//Only report that the mode is done after the final tile has been queued.
+	const bool bCollapsed = CollapseSuperPositionBatch(CollapseResults);
+
+	//Every step costs time proportional to the length of the frontier left once frozen spans are taken out.
+	StepsRun++;
+	LastStepFrontierLength = Shape.Num();
+	LastStepActiveFrontierLength = ActiveSockets.Num();
+	PeakStepFrontierLength = FMath::Max<int>(PeakStepFrontierLength, Shape.Num());
+	TotalStepFrontierLength += Shape.Num();
+	UE_LOG(LogTerrainTool, Verbose, TEXT("Frontier has %i sockets, %i of them active"), Shape.Num(), ActiveSockets.Num());
+
+	return bNeedsMoreCollapses && bCollapsed;
+}
+
+/**
+ * Finds the socket whose midpoint is closest to a location, including frozen sockets. Puts back the frozen spans that could hold a closer socket than those left in the shape. Must not be called while merges are pending.
+ *
+ * @param Location - The location to search from, in terrain space.
+ * @return The index of the closest socket, or 0 if the shape is empty.
+ */
+int FTerrainGenerationWorker::GetClosestSocket(const FVector2D Location)
+{
+	int ClosestSocketIndex = 0;
+	float ClosestDistanceSquared = MAX_FLT;
+	for (int SearchIndex = 0; SearchIndex < Shape.Num(); SearchIndex++)
+	{
+		//The face of a socket standing in for a span is not where the socket is, so it is found through the span's bounds instead.
+		if (IsFrozenSpanSocket(SearchIndex))
+		{
+			continue;
+		}
+
+		const float SearchDistanceSquared = FVector2D::DistSquared((Shape.Vertices[SearchIndex].Location + Shape.Vertices[(SearchIndex + 1) % Shape.Num()].Location) / 2, Location);
+		if (SearchDistanceSquared < ClosestDistanceSquared)
+		{
+			ClosestDistanceSquared = SearchDistanceSquared;
+			ClosestSocketIndex = SearchIndex;
+		}
+	}
+
+	//Only the spans that could be as close are put back and searched.
+	TArray<int> CloserSpans = TArray<int>();
+	for (int SpanIndex = 0; SpanIndex < FrozenSpans.Num(); SpanIndex++)
+	{
+		if (FrozenSpans[SpanIndex].Bounds.ComputeSquaredDistanceToPoint(Location) <= ClosestDistanceSquared)
+		{
+			CloserSpans.Emplace(SpanIndex);
+		}
+	}
+
+	if (!CloserSpans.IsEmpty())
+	{
+		ExpandFrozenSpans(CloserSpans);
+		return GetClosestSocket(Location);
+	}
+	return ClosestSocketIndex;
+}
+
+/**
+ * Collapses a single superposition of the given tile at the socket closest to a location.
+ *
+ * @param Location - Where to place the tile, in world space.
+ * @param TileIndex - The index of the spawnable tile to place.
+ */
+void FTerrainGenerationWorker::PlaceTileAt(const FVector Location, const int TileIndex)
+{
+	if (SuperPositions.IsEmpty() || TileCatalog.Num() == 0 || !CollapseMode.IsValid())
+	{
+		return;
+	}
+
+	const int SolverTileIndex = TileCatalog.SolverTileIndices.IsValidIndex(TileIndex) ? TileCatalog.SolverTileIndices[TileIndex] : 0;
+
+	//Get socket closest to the location. A tile can be placed anywhere, including outside of the running mode's bounds.
+	const FVector2D LocalLocation = FVector2D(CollapseMode->TerrainTransform.InverseTransformPosition(Location));
+	int SocketIndex = GetClosestSocket(LocalLocation);
+
+	//Only the chosen socket is thawed, so that placing a tile costs the same however much of the terrain is frozen. Thawing may force a collapse there, so search again until an unfrozen socket is closest.
+	while (FrozenSockets.IsValidIndex(SocketIndex) && FrozenSockets[SocketIndex] && !bStopped)
+	{
+		ThawSocket(SocketIndex);
+		SocketIndex = GetClosestSocket(LocalLocation);
+	}
+
+	if (bStopped)
+	{
+		return;
+	}
+	BeginDecision();
+
+	//Get possible collapses around selected socket
+	TArray<int> PossibleFaces = TArray<int>();
+	for (int FaceIndex = 0; FaceIndex < SuperPositions[SocketIndex][SolverTileIndex].Num(); FaceIndex++)
+	{
+		if (SuperPositions[SocketIndex][SolverTileIndex][FaceIndex])
+		{
+			PossibleFaces.Emplace(FaceIndex);
+		}
+	}
+
+	//End if no valid collapses
+	if (PossibleFaces.IsEmpty())
+	{
+		UE_LOG(LogTerrainTool, Error, TEXT("Shapes do not tile, Consider adding another shape to fill the gap at the marked point or regenerating the terrain"));
+		if (Shape.Num() > 0)
+		{
+			ReportError(GetSocketLocation(SocketIndex));
+		}
+
+		//Leave the socket as the running mode expects it.
+		if (Shape.Num() > 0 && !IsSocketInFrozenBounds(SocketIndex))
+		{
+			FreezeSocket(SocketIndex);
+			ActiveSockets.Remove(SocketIndex);
+			OrderedSockets.Remove(SocketIndex);
+		}
+		return;
+	}
+
+	CollapseSuperPosition(FIntVector(SocketIndex, SolverTileIndex, PossibleFaces[RandomStream.RandHelper(PossibleFaces.Num())]));
+}
+
+/**
+ * Attempts to collapse a super position at a given index.
+ *
+ * @param Index - X = Socket to connect to, Y = Tile to add, Z = Socket on tile to connect to.
+ * @return Whether or not the collapse was successful.
+ */
+bool FTerrainGenerationWorker::CollapseSuperPosition(FIntVector Index)
+{
+	if (IsSuperPositionPossible(Index) && CommitCollapse(Index))
+	{
+		RefreshSuperPositions();
+		return true;
+	}
+	UE_LOG(LogTerrainTool, Error, TEXT("Collapse Failed"));
+	return false;
+}
+
+/**
+ * Collapses a batch of superpositions and refreshes the superpositions once for all of them. Collapses at sockets changed by an earlier collapse of the batch are skipped.
+ * With parallel refreshes, collapses whose merges depend on disjoint parts of the shape are committed on several threads at once, and the rest are retried one at a time.
+ *
+ * @param Indices - The superpositions to collapse, indexed by the sockets of the shape before the batch. The first must be valid.
+ * @return Whether or not the first collapse was successful.
+ */
+bool FTerrainGenerationWorker::CollapseSuperPositionBatch(const TArray<FIntVector>& Indices)
+{
+	if (Indices.IsEmpty() || !IsSuperPositionPossible(Indices[0]))
+	{
+		UE_LOG(LogTerrainTool, Error, TEXT("Collapse Failed"));
+		return false;
+	}
+
+	//The collapses still to be committed one at a time.
+	TArray<FIntVector> SerialIndices = TArray<FIntVector>();
+	bool bCommitted = false;
+	if (Config.bParallelRefresh && !bMergesPending && Indices.Num() >= CVarTerrainConcurrentCollapses.GetValueOnAnyThread())
+	{
+		bCommitted = CommitCollapsesConcurrently(Indices, SerialIndices);
+	}
+	else
+	{
+		bCommitted = CommitCollapse(Indices[0]);
+		SerialIndices.Append(Indices.GetData() + 1, Indices.Num() - 1);
+	}
+
+	if (!bCommitted)
+	{
+		UE_LOG(LogTerrainTool, Error, TEXT("Collapse Failed"));
+		RefreshSuperPositions();
+		return false;
+	}
+
+	for (int BatchIndex = 0; BatchIndex < SerialIndices.Num() && !bStopped; BatchIndex++)
+	{
+		//Find where the socket has moved to since the batch started.
+		const FIntVector& EachIndex = SerialIndices[BatchIndex];
+		const int SocketIndex = PendingMovedSockets.IsValidIndex(EachIndex.X) ? PendingMovedSockets[EachIndex.X] : INDEX_NONE;
+		if (SocketIndex != INDEX_NONE && !PendingStaleSockets[SocketIndex] && IsSuperPositionPossible(EachIndex))
+		{
+			CommitCollapse(FIntVector(SocketIndex, EachIndex.Y, EachIndex.Z));
+		}
+	}
+
+	RefreshSuperPositions();
+	return true;
+}
+
+/**
+ * Merges a tile into the shape and records which sockets must be refreshed without refreshing them.
+ *
+ * @param Index - X = Socket of the current shape to connect to, Y = Tile to add, Z = Socket on tile to connect to.
+ * @return Whether or not the merge was successful.
+ */
+bool FTerrainGenerationWorker::CommitCollapse(FIntVector Index)
+{
+	const int SocketIndex = Index.X;
+	const int ShapeIndex = Index.Y;
+	const int FaceIndex = ChooseEquivalentFace(ShapeIndex, Index.Z);
+
+	FTerrainShape NewShape;
+	FTerrainShapeMergeResult MergeResult;
+
+	if (ensureAlwaysMsgf(Shape.MergeShape(NewShape, MergeResult, SocketIndex, TileCatalog.TileShapes[ShapeIndex], FaceIndex), TEXT("Super Position Array False at %i, %i, %i"), SocketIndex, ShapeIndex, FaceIndex))
+	{
+		EnqueueCollapsedTiles(ShapeIndex, MergeResult);
+
+		const int PreviousNumberOfSockets = Shape.Num();
+		Shape = MoveTemp(NewShape);
+		RecordMerge(MergeResult, PreviousNumberOfSockets);
+
+		if (LastCollapseTime - LastSnapshotTime >= Config.ShapeSnapshotInterval)
+		{
+			PublishShapeSnapshot();
+		}
+		NotifyUpdate();
+
+		return true;
+	}
+	ReportError(GetSocketLocation(SocketIndex));
+	return false;
+}
+
+/**
+ * Commits the collapses of a batch on several threads at once. Each collapse reserves the segment of the shape its merge depends on, and is committed only if no earlier collapse of the batch reserved any of the same vertices. The merges are found on copies of their own segments and spliced in together.
+ *
+ * @param Indices - The superpositions to collapse, indexed by the sockets of the shape before the batch. Must not be called while merges are pending.
+ * @param Conflicts - Set to the possible collapses that were not committed, in batch order, to be retried one at a time.
+ * @return Whether or not the first collapse was committed.
+ */
+bool FTerrainGenerationWorker::CommitCollapsesConcurrently(const TArray<FIntVector>& Indices, TArray<FIntVector>& Conflicts)
+{
+	struct FSegmentCollapse
+	{
+		//The superposition to collapse.
+		FIntVector Index = FIntVector();
+
+		//The first vertex of the segment of the shape the merge depends on.
+		int SegmentStart = 0;
+
+		//The number of vertices in the segment. Zero if the collapse is not possible.
+		int SegmentLength = 0;
+
+		//Whether or not the collapse reserved its whole segment and merged into it.
+		bool bCommitted = false;
+
+		//The face of the tile to connect with.
+		int FaceIndex = 0;
+
+		//The result of merging the tile into the segment.
+		FTerrainShapeMergeResult MergeResult = FTerrainShapeMergeResult();
+
+		//The merge, described by the vertices of the whole shape.
+		FTerrainSegmentMerge Merge = FTerrainSegmentMerge();
+	};
+
+	Conflicts.Reset();
+	const int NumberOfSockets = Shape.Num();
+	TArray<FSegmentCollapse> Collapses = TArray<FSegmentCollapse>();
+	Collapses.SetNum(Indices.Num());
+	for (int BatchIndex = 0; BatchIndex < Indices.Num(); BatchIndex++)
+	{
+		FSegmentCollapse& Collapse = Collapses[BatchIndex];
+		Collapse.Index = Indices[BatchIndex];
+		if (!IsSuperPositionPossible(Collapse.Index))
+		{
+			continue;
+		}
+
+		//The merge only reads the vertices its reach covers. A vertex of margin on either side keeps merges from meeting at a shared vertex.
+		const FTerrainSocketCandidates& Candidates = SocketCandidates[Collapse.Index.X];
+		Collapse.SegmentLength = FMath::Min(Candidates.ReachBefore + Candidates.ReachAfter + 3, NumberOfSockets);
+		Collapse.SegmentStart = UPTTMath::Mod(Collapse.Index.X - Candidates.ReachBefore - 1, NumberOfSockets);
+	}
+
+	//Reserve each vertex for the earliest collapse whose segment covers it. The earliest always wins, however the threads run, so the same batch always commits the same collapses.
+	VertexReservations.Init(MAX_int32, NumberOfSockets);
+	ParallelFor(Collapses.Num(), [&](int32 BatchIndex)
+		{
+			const FSegmentCollapse& Collapse = Collapses[BatchIndex];
+			for (int SegmentOffset = 0; SegmentOffset < Collapse.SegmentLength; SegmentOffset++)
+			{
+				int32* Reservation = &VertexReservations[(Collapse.SegmentStart + SegmentOffset) % NumberOfSockets];
+				int32 Reserved = FPlatformAtomics::AtomicRead(Reservation);
+				while (BatchIndex < Reserved)
+				{
+					const int32 PreviousReserved = FPlatformAtomics::InterlockedCompareExchange(Reservation, BatchIndex, Reserved);
+					Reserved = PreviousReserved == Reserved ? BatchIndex : PreviousReserved;
+				}
+			}
+		});
+
+	//Only commit the collapses that reserved their whole segment. Faces are chosen in batch order so that the random numbers drawn do not depend on the threads.
+	for (int BatchIndex = 0; BatchIndex < Collapses.Num(); BatchIndex++)
+	{
+		FSegmentCollapse& Collapse = Collapses[BatchIndex];
+		Collapse.bCommitted = Collapse.SegmentLength > 0;
+		for (int SegmentOffset = 0; SegmentOffset < Collapse.SegmentLength && Collapse.bCommitted; SegmentOffset++)
+		{
+			Collapse.bCommitted = VertexReservations[(Collapse.SegmentStart + SegmentOffset) % NumberOfSockets] == BatchIndex;
+		}
+
+		if (Collapse.bCommitted)
+		{
+			Collapse.FaceIndex = ChooseEquivalentFace(Collapse.Index.Y, Collapse.Index.Z);
+		}
+	}
+
+	//Merge each tile into a copy of its own segment. The segments do not overlap, so each merge finds what it would find on the whole shape.
+	ParallelFor(Collapses.Num(), [&](int32 BatchIndex)
+		{
+			FSegmentCollapse& Collapse = Collapses[BatchIndex];
+			if (!Collapse.bCommitted)
+			{
+				return;
+			}
+
+			FTerrainShape Segment = FTerrainShape();
+			Segment.Vertices.Reserve(Collapse.SegmentLength);
+			for (int SegmentOffset = 0; SegmentOffset < Collapse.SegmentLength; SegmentOffset++)
+			{
+				Segment.Vertices.Emplace(Shape.Vertices[(Collapse.SegmentStart + SegmentOffset) % NumberOfSockets]);
+			}
+
+			FTerrainShape MergedSegment = FTerrainShape();
+			const int SegmentSocketIndex = UPTTMath::Mod(Collapse.Index.X - Collapse.SegmentStart, NumberOfSockets);
+			if (!Segment.MergeShape(MergedSegment, Collapse.MergeResult, SegmentSocketIndex, TileCatalog.TileShapes[Collapse.Index.Y], Collapse.FaceIndex))
+			{
+				Collapse.bCommitted = false;
+				return;
+			}
+
+			//The merged segment starts at the last merged vertex and ends with the vertices of the tile.
+			const int NumberOfKeptVertices = Collapse.SegmentLength - Collapse.MergeResult.Shrinkage;
+			FTerrainSegmentMerge& Merge = Collapse.Merge;
+			Merge.Shrinkage = Collapse.MergeResult.Shrinkage;
+			Merge.FirstMergedVertex = UPTTMath::Mod(Collapse.SegmentStart + UPTTMath::Mod(-Collapse.MergeResult.Offset, Collapse.SegmentLength) - Merge.Shrinkage, NumberOfSockets);
+			Merge.LastMergedVertex = MergedSegment.Vertices[0];
+			Merge.NewVertices.Append(MergedSegment.Vertices.GetData() + NumberOfKeptVertices, Collapse.MergeResult.Growth);
+		});
+
+	//Spawn the tiles in batch order, so that the variants chosen do not depend on the threads. The possible collapses that were not committed are retried once the rest are in.
+	TArray<FTerrainSegmentMerge> Merges = TArray<FTerrainSegmentMerge>();
+	for (int BatchIndex = 0; BatchIndex < Collapses.Num(); BatchIndex++)
+	{
+		FSegmentCollapse& Collapse = Collapses[BatchIndex];
+		if (Collapse.bCommitted)
+		{
+			EnqueueCollapsedTiles(Collapse.Index.Y, Collapse.MergeResult);
+			Merges.Emplace(MoveTemp(Collapse.Merge));
+		}
+		else if (BatchIndex == 0)
+		{
+			ensureAlwaysMsgf(false, TEXT("Super Position Array False at %i, %i, %i"), Collapse.Index.X, Collapse.Index.Y, Collapse.FaceIndex);
+			ReportError(GetSocketLocation(Collapse.Index.X));
+		}
+		else if (Collapse.SegmentLength > 0)
+		{
+			Conflicts.Emplace(Collapse.Index);
+		}
+	}
+
+	if (Merges.IsEmpty())
+	{
+		return false;
+	}
+
+	//Splice the merges in along the shape, starting from the one whose last merged vertex comes first.
+	Merges.Sort([NumberOfSockets](const FTerrainSegmentMerge& A, const FTerrainSegmentMerge& B)
+		{
+			return (A.FirstMergedVertex + A.Shrinkage) % NumberOfSockets < (B.FirstMergedVertex + B.Shrinkage) % NumberOfSockets;
+		});
+	SpliceSegmentMerges(Merges);
+
+	if (LastCollapseTime - LastSnapshotTime >= Config.ShapeSnapshotInterval)
+	{
+		PublishShapeSnapshot();
+	}
+	NotifyUpdate();
+
+	return Collapses[0].bCommitted;
+}
+
+/**
+ * Chooses which of the equivalent faces of a symmetric tile to connect with. Tiles without symmetry have only one, so no random number is drawn for them.
+ *
+ * @param ShapeIndex - The solver tile being collapsed.
+ * @param FaceIndex - The face of the superposition being collapsed.
+ * @return The face of the tile to connect with.
+ */
+int FTerrainGenerationWorker::ChooseEquivalentFace(const int ShapeIndex, const int FaceIndex)
+{
+	const int SymmetryPeriod = TileCatalog.TileSymmetryPeriods[ShapeIndex];
+	const int NumberOfEquivalentFaces = TileCatalog.TileShapes[ShapeIndex].Num() / SymmetryPeriod;
+	int EquivalentFaceIndex = FaceIndex % SymmetryPeriod;
+	if (NumberOfEquivalentFaces > 1)
+	{
+		EquivalentFaceIndex += SymmetryPeriod * RandomStream.RandHelper(NumberOfEquivalentFaces);
+	}
+	return EquivalentFaceIndex;
+}
+
+/**
+ * Queues the tiles of a collapsed solver tile to be spawned and counts them.
+ *
+ * @param ShapeIndex - The solver tile that was collapsed.
+ * @param MergeResult - The result of merging it into the shape.
+ */
+void FTerrainGenerationWorker::EnqueueCollapsedTiles(const int ShapeIndex, const FTerrainShapeMergeResult& MergeResult)
+{
+	//Macro tiles are spawned as the tiles they are made of.
+	const TArray<FTerrainMacroTileMember>& Members = TileCatalog.TileMembers[ShapeIndex];
+	if (Members.IsEmpty())
+	{
+		NewTerrainTiles.Enqueue(FTerrainTileInstanceData(TileCatalog.ChooseVariant(ShapeIndex, RandomStream, RequiredTileIndex), MergeResult));
+		TilesPlaced++;
+	}
+	else
+	{
+		for (const FTerrainMacroTileMember& EachMember : Members)
+		{
+			FTerrainShapeMergeResult MemberMergeResult = MergeResult;
+			MemberMergeResult.Transform = EachMember.Transform.Concatenate(MergeResult.Transform);
+			NewTerrainTiles.Enqueue(FTerrainTileInstanceData(TileCatalog.ChooseVariant(EachMember.SolverTileIndex, RandomStream, EachMember.PreferredVariant != INDEX_NONE ? EachMember.PreferredVariant : RequiredTileIndex), MemberMergeResult));
+		}
+		TilesPlaced += Members.Num();
+	}
+	AreaFilled = AreaFilled + TileCatalog.TileAreas[ShapeIndex];
+	LastCollapseTime = FPlatformTime::Seconds();
+}
+
+/**
+ * Starts recording merges if none are pending, with every socket where it was at the last refresh.
+ *
+ * @param NumberOfSockets - The number of sockets of the shape at the last refresh.
+ */
+void FTerrainGenerationWorker::BeginPendingMerges(const int NumberOfSockets)
+{
+	if (!bMergesPending)
+	{
+		bMergesPending = true;
+		PendingSourceSockets.SetNumUninitialized(NumberOfSockets);
+		PendingMovedSockets.SetNumUninitialized(NumberOfSockets);
+		for (int SocketIndex = 0; SocketIndex < NumberOfSockets; SocketIndex++)
+		{
+			PendingSourceSockets[SocketIndex] = SocketIndex;
+			PendingMovedSockets[SocketIndex] = SocketIndex;
+		}
+		PendingStaleSockets.Init(false, NumberOfSockets);
+	}
+}
+
+/**
+ * Records how a merge moved the sockets of the shape and marks the sockets it affected as stale.
+ *
+ * @param MergeResult - The result of the merge.
+ * @param PreviousNumberOfSockets - The number of sockets of the shape before the merge.
+ */
+void FTerrainGenerationWorker::RecordMerge(const FTerrainShapeMergeResult& MergeResult, const int PreviousNumberOfSockets)
+{
+	BeginPendingMerges(PreviousNumberOfSockets);
+
+	//The merged sockets are removed and the rest are rotated so that the new sockets are at the end. Written to the spare arrays, which are swapped in afterwards, so that merging does not allocate.
+	const int NumberOfKeptSockets = PreviousNumberOfSockets - MergeResult.Shrinkage;
+	MergedSourceSockets.SetNumUninitialized(Shape.Num());
+	MergedStaleSockets.SetNumUninitialized(Shape.Num());
+	MergedStaleSockets.SetRange(0, Shape.Num(), true);
+	for (int SocketIndex = 0; SocketIndex < NumberOfKeptSockets; SocketIndex++)
+	{
+		const int PreviousSocketIndex = UPTTMath::Mod(SocketIndex - MergeResult.Offset, PreviousNumberOfSockets);
+		MergedSourceSockets[SocketIndex] = PendingSourceSockets[PreviousSocketIndex];
+		MergedStaleSockets[SocketIndex] = PendingStaleSockets[PreviousSocketIndex];
+		if (MergedSourceSockets[SocketIndex] != INDEX_NONE)
+		{
+			PendingMovedSockets[MergedSourceSockets[SocketIndex]] = SocketIndex;
+		}
+	}
+	for (int SocketIndex = FMath::Max(NumberOfKeptSockets, 0); SocketIndex < Shape.Num(); SocketIndex++)
+	{
+		MergedSourceSockets[SocketIndex] = INDEX_NONE;
+	}
+
+	//A socket may have gained or lost collapses only if the vertices its merges depend on include one the merge removed or changed.
+	if (PreviousNumberOfSockets > 0)
+	{
+		const int LastMergedVertex = UPTTMath::Mod(-MergeResult.Offset, PreviousNumberOfSockets);
+		const int FirstMergedVertex = UPTTMath::Mod(LastMergedVertex - MergeResult.Shrinkage, PreviousNumberOfSockets);
+
+		//The sockets between the merged vertices no longer exist.
+		for (int RemovedIndex = 0; RemovedIndex < MergeResult.Shrinkage; RemovedIndex++)
+		{
+			const int RemovedSource = PendingSourceSockets[(FirstMergedVertex + RemovedIndex) % PreviousNumberOfSockets];
+			if (RemovedSource != INDEX_NONE)
+			{
+				PendingMovedSockets[RemovedSource] = INDEX_NONE;
+			}
+		}
+
+		for (int SocketIndex = 0; SocketIndex < NumberOfKeptSockets; SocketIndex++)
+		{
+			const int PreviousSocketIndex = UPTTMath::Mod(SocketIndex - MergeResult.Offset, PreviousNumberOfSockets);
+			if (MergedStaleSockets[SocketIndex])
+			{
+				continue;
+			}
+
+			const FTerrainSocketCandidates& Candidates = SocketCandidates[PendingSourceSockets[PreviousSocketIndex]];
+			MergedStaleSockets[SocketIndex] = UPTTMath::Mod(FirstMergedVertex - PreviousSocketIndex, PreviousNumberOfSockets) <= Candidates.ReachAfter || UPTTMath::Mod(PreviousSocketIndex - LastMergedVertex, PreviousNumberOfSockets) <= Candidates.ReachBefore;
+		}
+
+		//The sockets standing in for frozen spans move with the rest. A margin keeps merges away from them, so none is ever merged.
+		for (int SpanIndex = FrozenSpans.Num() - 1; SpanIndex >= 0; SpanIndex--)
+		{
+			FTerrainFrozenSpan& Span = FrozenSpans[SpanIndex];
+			if (ensureMsgf(UPTTMath::Mod(Span.SocketIndex - FirstMergedVertex, PreviousNumberOfSockets) >= MergeResult.Shrinkage, TEXT("Merged with a frozen span at %i"), Span.SocketIndex))
+			{
+				Span.SocketIndex = UPTTMath::Mod(Span.SocketIndex + MergeResult.Offset, PreviousNumberOfSockets);
+			}
+			else
+			{
+				FrozenSpans.RemoveAt(SpanIndex);
+			}
+		}
+	}
+
+	Swap(PendingSourceSockets, MergedSourceSockets);
+	Swap(PendingStaleSockets, MergedStaleSockets);
+}
+
+/**
+ * Replaces the segments of the shape changed by merges of disjoint segments, and records how the sockets moved and which sockets must be refreshed as RecordMerge would for each merge in turn.
+ *
+ * @param Merges - The merges to splice in. Their segments must not overlap, and they must be in order along the shape, starting from the one whose last merged vertex comes first. Must not be called while merges are pending.
+ */
+void FTerrainGenerationWorker::SpliceSegmentMerges(const TArray<FTerrainSegmentMerge>& Merges)
+{
+	const int PreviousNumberOfSockets = Shape.Num();
+	if (Merges.IsEmpty() || PreviousNumberOfSockets == 0 || !ensureMsgf(!bMergesPending, TEXT("Spliced merges while merges were pending")))
+	{
+		return;
+	}
+	BeginPendingMerges(PreviousNumberOfSockets);
+
+	int NumberOfSockets = PreviousNumberOfSockets;
+	for (const FTerrainSegmentMerge& EachMerge : Merges)
+	{
+		NumberOfSockets += EachMerge.NewVertices.Num() - EachMerge.Shrinkage;
+	}
 
-		if (ensureAlwaysMsgf(Shape.MergeShape(NewShape, MergeResult, SocketIndex, TileShapes[ShapeIndex], FaceIndex), TEXT("Super Position Array False at %i, %i, %i"), SocketIndex, ShapeIndex, FaceIndex))
+	//Written to the spare arrays, which are swapped in afterwards. New sockets have no source and are always stale.
+	TArray<FTerrainVertex> NewVertices = TArray<FTerrainVertex>();
+	NewVertices.Reserve(NumberOfSockets);
+	MergedSourceSockets.SetNumUninitialized(NumberOfSockets);
+	MergedStaleSockets.SetNumUninitialized(NumberOfSockets);
+	MergedStaleSockets.SetRange(0, NumberOfSockets, true);
+	const auto AddNewVertices = [&](const FTerrainSegmentMerge& Merge)
+	{
+		for (const FTerrainVertex& EachVertex : Merge.NewVertices)
 		{
-			TerrainTiles.Emplace(FTerrainTileInstanceData(ShapeIndex, MergeResult));
-			Shape = NewShape;
-			RefreshSuperPositions(MergeResult.Growth, MergeResult.Shrinkage, MergeResult.Offset);
+			MergedSourceSockets[NewVertices.Emplace(EachVertex)] = INDEX_NONE;
+		}
+	};
 
-			return true;
+	//Walk the shape from the last merged vertex of the first merge, so that its new vertices end up at the end as they would after a single merge. Offsets are along the walk.
+	const int StartVertex = (Merges[0].FirstMergedVertex + Merges[0].Shrinkage) % PreviousNumberOfSockets;
+	const auto GetLastMergedOffset = [&](const int EachMergeIndex)
+	{
+		return UPTTMath::Mod(Merges[EachMergeIndex].FirstMergedVertex + Merges[EachMergeIndex].Shrinkage - StartVertex, PreviousNumberOfSockets);
+	};
+
+	int MergeIndex = 0;
+	for (int WalkOffset = 0; WalkOffset < PreviousNumberOfSockets; WalkOffset++)
+	{
+		//The new vertices of a merge go just before its last merged vertex.
+		if (MergeIndex + 1 < Merges.Num() && WalkOffset == GetLastMergedOffset(MergeIndex + 1))
+		{
+			MergeIndex++;
+			AddNewVertices(Merges[MergeIndex]);
+		}
+
+		const int PreviousSocketIndex = (StartVertex + WalkOffset) % PreviousNumberOfSockets;
+		const int PreviousSource = PendingSourceSockets[PreviousSocketIndex];
+		const int LastMergedOffset = GetLastMergedOffset(MergeIndex);
+		const int NextFirstMergedOffset = MergeIndex + 1 < Merges.Num() ? GetLastMergedOffset(MergeIndex + 1) - Merges[MergeIndex + 1].Shrinkage : PreviousNumberOfSockets - Merges[0].Shrinkage;
+
+		//The sockets between the merged vertices no longer exist.
+		if (WalkOffset >= NextFirstMergedOffset)
+		{
+			if (PreviousSource != INDEX_NONE)
+			{
+				PendingMovedSockets[PreviousSource] = INDEX_NONE;
+			}
+			continue;
+		}
+
+		const int SocketIndex = NewVertices.Emplace(WalkOffset == LastMergedOffset ? Merges[MergeIndex].LastMergedVertex : Shape.Vertices[PreviousSocketIndex]);
+		MergedSourceSockets[SocketIndex] = PreviousSource;
+		MergedStaleSockets[SocketIndex] = PendingStaleSockets[PreviousSocketIndex];
+		if (PreviousSource == INDEX_NONE)
+		{
+			continue;
+		}
+		PendingMovedSockets[PreviousSource] = SocketIndex;
+
+		//A socket may have gained or lost collapses only if the vertices its merges depend on include one a merge removed or changed. The nearest merges on either side are the only ones that can reach it.
+		if (!MergedStaleSockets[SocketIndex])
+		{
+			const FTerrainSocketCandidates& Candidates = SocketCandidates[PreviousSource];
+			MergedStaleSockets[SocketIndex] = NextFirstMergedOffset - WalkOffset <= Candidates.ReachAfter || WalkOffset - LastMergedOffset <= Candidates.ReachBefore;
 		}
-		CollapseMode->ErrorLocation = CollapseMode->TerrainTransform.TransformPosition(FVector(((Shape.Vertices[SocketIndex].Location + Shape.Vertices[(SocketIndex + 1) % Shape.Num()].Location) / 2), 0));
 	}
-	UE_LOG(LogTerrainTool, Error, TEXT("Collapse Failed"));
-	return false;
+	AddNewVertices(Merges[0]);
+	ensureMsgf(NewVertices.Num() == NumberOfSockets, TEXT("Spliced %i sockets rather than %i"), NewVertices.Num(), NumberOfSockets);
+
+	//The sockets standing in for frozen spans move with the rest. A margin keeps merges away from them, so none is ever merged.
+	for (int SpanIndex = FrozenSpans.Num() - 1; SpanIndex >= 0; SpanIndex--)
+	{
+		FTerrainFrozenSpan& Span = FrozenSpans[SpanIndex];
+		const int MovedSocketIndex = PendingMovedSockets[Span.SocketIndex];
+		if (ensureMsgf(MovedSocketIndex != INDEX_NONE, TEXT("Merged with a frozen span at %i"), Span.SocketIndex))
+		{
+			Span.SocketIndex = MovedSocketIndex;
+		}
+		else
+		{
+			FrozenSpans.RemoveAt(SpanIndex);
+		}
+	}
+
+	Shape.Vertices = MoveTemp(NewVertices);
+	Swap(PendingSourceSockets, MergedSourceSockets);
+	Swap(PendingStaleSockets, MergedStaleSockets);
+}
+
+/**
+ * Determines whether a socket is inside of the frozen bounds.
+ *
+ * @param SocketIndex - The socket to check.
+ * @return Whether or not the socket may still be collapsed.
+ */
+bool FTerrainGenerationWorker::IsSocketInFrozenBounds(const int SocketIndex) const
+{
+	//The face of a socket standing in for a span is not where the socket is, and every socket of a span is frozen.
+	if (IsFrozenSpanSocket(SocketIndex))
+	{
+		return false;
+	}
+	return !FrozenBounds.IsValid() || FrozenBounds->IsInBounds((Shape.Vertices[SocketIndex].Location + Shape.Vertices[(SocketIndex + 1) % Shape.Num()].Location) / 2);
+}
+
+/**
+ * Freezes the sockets outside of a mode's bounds and thaws the sockets inside of them. Must not be called while merges are pending.
+ *
+ * @param Bounds - The mode whose bounds to use. Null thaws every socket.
+ */
+void FTerrainGenerationWorker::SetFrozenBounds(const FTerrainCollapseModeConfigPtr& Bounds)
+{
+	//Every socket is checked against the new bounds, so every span is put back first.
+	TArray<int> SpanIndices = TArray<int>();
+	for (int SpanIndex = 0; SpanIndex < FrozenSpans.Num(); SpanIndex++)
+	{
+		SpanIndices.Emplace(SpanIndex);
+	}
+	ExpandFrozenSpans(SpanIndices);
+	FrozenSocketsAfterCompaction = 0;
+
+	FrozenBounds = Bounds;
+	FrozenSockets.SetNum(Shape.Num(), false);
+
+	for (int SocketIndex = 0; SocketIndex < Shape.Num(); SocketIndex++)
+	{
+		const bool bInBounds = IsSocketInFrozenBounds(SocketIndex);
+		if (bInBounds && FrozenSockets[SocketIndex])
+		{
+			//Thawed sockets are re-evaluated from scratch.
+			BeginPendingMerges(Shape.Num());
+			PendingStaleSockets[SocketIndex] = true;
+		}
+		else if (!bInBounds && !FrozenSockets[SocketIndex])
+		{
+			FreezeSocket(SocketIndex);
+		}
+	}
+
+	OrderedSockets.Reset();
+	RefreshSuperPositions();
+	RebuildActiveSockets();
+	RebuildOrderedSockets();
+}
+
+/**
+ * Freezes a single socket, dropping its superpositions. Does not update the active or ordered sockets.
+ *
+ * @param SocketIndex - The socket to freeze.
+ */
+void FTerrainGenerationWorker::FreezeSocket(const int SocketIndex)
+{
+	FrozenSockets[SocketIndex] = true;
+	SuperPositions[SocketIndex].Empty();
+	SocketCandidates[SocketIndex] = FTerrainSocketCandidates::MakeFrozen();
+}
+
+/**
+ * Thaws a single frozen socket and re-evaluates it, even if it is outside of the frozen bounds. Must not be called while merges are pending.
+ *
+ * @param SocketIndex - The socket to thaw.
+ */
+void FTerrainGenerationWorker::ThawSocket(const int SocketIndex)
+{
+	BeginPendingMerges(Shape.Num());
+	PendingStaleSockets[SocketIndex] = true;
+	ThawingSocket = SocketIndex;
+	RefreshSuperPositions();
+}
+
+/**
+ * Rebuilds the list of sockets that are not frozen.
+ */
+void FTerrainGenerationWorker::RebuildActiveSockets()
+{
+	ActiveSockets.Reset();
+	for (int SocketIndex = 0; SocketIndex < Shape.Num(); SocketIndex++)
+	{
+		if (!FrozenSockets[SocketIndex])
+		{
+			ActiveSockets.Emplace(SocketIndex);
+		}
+	}
+}
+
+/**
+ * Moves the active sockets to where the merges since the last refresh moved them and adds the refreshed sockets that are not frozen. Sockets that were not refreshed are still frozen or not, so only the refreshed sockets are checked.
+ *
+ * @param MovedSockets - Where each socket of the shape before the merges has moved to, or INDEX_NONE if it was removed.
+ * @param StaleSockets - The sockets that were refreshed.
+ */
+void FTerrainGenerationWorker::UpdateActiveSockets(const TArray<int>& MovedSockets, const TBitArray<>& StaleSockets)
+{
+	//Merges rotate the sockets they keep, so the kept sockets are in order but for one wrap back to the start of the shape.
+	TArray<int> KeptSockets = TArray<int>();
+	KeptSockets.Reserve(ActiveSockets.Num());
+	int WrapIndex = 0;
+	for (const int EachSocket : ActiveSockets)
+	{
+		const int MovedSocket = MovedSockets.IsValidIndex(EachSocket) ? MovedSockets[EachSocket] : INDEX_NONE;
+		if (MovedSocket != INDEX_NONE && !StaleSockets[MovedSocket])
+		{
+			if (!KeptSockets.IsEmpty() && MovedSocket < KeptSockets.Last())
+			{
+				WrapIndex = KeptSockets.Num();
+			}
+			KeptSockets.Emplace(MovedSocket);
+		}
+	}
+
+	//Merge the kept sockets from the wrap onwards with the refreshed sockets that are not frozen.
+	ActiveSockets.Reset();
+	int KeptIndex = 0;
+	TConstSetBitIterator<> StaleSocket(StaleSockets);
+	while (KeptIndex < KeptSockets.Num() || StaleSocket)
+	{
+		const int NextKeptSocket = KeptIndex < KeptSockets.Num() ? KeptSockets[(WrapIndex + KeptIndex) % KeptSockets.Num()] : MAX_int32;
+		if (StaleSocket && StaleSocket.GetIndex() < NextKeptSocket)
+		{
+			if (!FrozenSockets[StaleSocket.GetIndex()])
+			{
+				ActiveSockets.Emplace(StaleSocket.GetIndex());
+			}
+			++StaleSocket;
+		}
+		else
+		{
+			ActiveSockets.Emplace(NextKeptSocket);
+			KeptIndex++;
+		}
+	}
+}
+
+/**
+ * Determines whether a socket stands in for a frozen span.
+ *
+ * @param SocketIndex - The socket to check.
+ * @return Whether or not the socket's face joins the ends of a frozen span.
+ */
+bool FTerrainGenerationWorker::IsFrozenSpanSocket(const int SocketIndex) const
+{
+	return !FrozenSpans.IsEmpty() && Shape.Vertices[SocketIndex].Type == FTerrainFrozenSpan::GetSocketType();
+}
+
+/**
+ * Gets how many frozen sockets are kept at each end of a frozen span. Twice as far as a merge at an active socket, along with its lookahead, can look along the frontier.
+ *
+ * @return The number of frozen sockets kept at each end of a frozen span.
+ */
+int FTerrainGenerationWorker::GetFrozenSpanMargin() const
+{
+	int LargestTileVertices = 0;
+	for (const FTerrainShape& EachTileShape : TileCatalog.TileShapes)
+	{
+		LargestTileVertices = FMath::Max(LargestTileVertices, EachTileShape.Num());
+	}
+
+	//A merge looks at most one vertex past its tile on either side, and the lookahead merges another tile next to it at every depth.
+	const int MergeReach = (LargestTileVertices + 1) * (Config.Lookahead.MaxDepth + 2);
+
+	//Spans are put back once an active socket is within half of the margin, so a step's merges and their refresh never reach the other half.
+	return 4 * MergeReach;
+}
+
+/**
+ * Takes the middle of every long run of frozen sockets out of the shape, keeping a margin at each end. The sockets left keep their order. Must not be called while merges are pending.
+ */
+void FTerrainGenerationWorker::CompactFrozenSockets()
+{
+	const int Margin = GetFrozenSpanMargin();
+
+	//A run of frozen sockets to take out. The socket standing in for it is kept, along with the vertex that ends it.
+	struct FSpanRange
+	{
+		int SocketIndex;
+		int FirstVertex;
+		int EndVertex;
+	};
+
+	//The first socket is never taken out so that the sockets left keep their order, and the sockets standing in for spans are never spanned again.
+	TArray<FSpanRange> NewSpans = TArray<FSpanRange>();
+	int RunStart = INDEX_NONE;
+	for (int SocketIndex = 1; SocketIndex <= Shape.Num(); SocketIndex++)
+	{
+		if (SocketIndex < Shape.Num() && FrozenSockets[SocketIndex] && !IsFrozenSpanSocket(SocketIndex))
+		{
+			RunStart = RunStart == INDEX_NONE ? SocketIndex : RunStart;
+			continue;
+		}
+
+		//Only worth taking out if at least a margin's worth of sockets is left between the margins.
+		if (RunStart != INDEX_NONE && SocketIndex - RunStart - 2 * Margin - 1 >= Margin)
+		{
+			NewSpans.Emplace(FSpanRange{ RunStart + Margin, RunStart + Margin + 1, SocketIndex - Margin });
+		}
+		RunStart = INDEX_NONE;
+	}
+
+	FrozenSocketsAfterCompaction = Shape.Num() - ActiveSockets.Num();
+	if (NewSpans.IsEmpty())
+	{
+		return;
+	}
+
+	//Where each socket is once the spans are taken out, or INDEX_NONE if it is taken out.
+	TArray<int> CompactedSockets = TArray<int>();
+	CompactedSockets.Init(INDEX_NONE, Shape.Num());
+
+	FTerrainShape CompactedShape = FTerrainShape();
+	TArray<TArray<TArray<bool>>> CompactedSuperPositions = TArray<TArray<TArray<bool>>>();
+	TArray<FTerrainSocketCandidates> CompactedSocketCandidates = TArray<FTerrainSocketCandidates>();
+	TBitArray<> CompactedFrozenSockets = TBitArray<>();
+	TArray<float> CompactedSocketOrders = TArray<float>();
+
+	int NextSpan = 0;
+	for (int SocketIndex = 0; SocketIndex < Shape.Num(); SocketIndex++)
+	{
+		if (NewSpans.IsValidIndex(NextSpan) && SocketIndex >= NewSpans[NextSpan].FirstVertex)
+		{
+			if (SocketIndex < NewSpans[NextSpan].EndVertex)
+			{
+				continue;
+			}
+			NextSpan++;
+		}
+
+		CompactedSockets[SocketIndex] = CompactedShape.Num();
+		CompactedShape.Vertices.Emplace(Shape.Vertices[SocketIndex]);
+		CompactedSuperPositions.Emplace(MoveTemp(SuperPositions[SocketIndex]));
+		CompactedSocketCandidates.Emplace(MoveTemp(SocketCandidates[SocketIndex]));
+		CompactedFrozenSockets.Add(FrozenSockets[SocketIndex]);
+		if (!SocketOrders.IsEmpty())
+		{
+			CompactedSocketOrders.Emplace(SocketOrders[SocketIndex]);
+		}
+	}
+
+	int NumberOfSpannedSockets = 0;
+	for (const FSpanRange& EachRange : NewSpans)
+	{
+		FTerrainFrozenSpan& NewSpan = FrozenSpans.AddDefaulted_GetRef();
+		NewSpan.SocketIndex = CompactedSockets[EachRange.SocketIndex];
+		NewSpan.SocketType = Shape.Vertices[EachRange.SocketIndex].Type;
+		NewSpan.Vertices.Append(&Shape.Vertices[EachRange.FirstVertex], EachRange.EndVertex - EachRange.FirstVertex);
+		for (int SocketIndex = EachRange.SocketIndex; SocketIndex < EachRange.EndVertex; SocketIndex++)
+		{
+			NewSpan.Bounds += (Shape.Vertices[SocketIndex].Location + Shape.Vertices[SocketIndex + 1].Location) / 2;
+		}
+		CompactedShape.Vertices[NewSpan.SocketIndex].Type = FTerrainFrozenSpan::GetSocketType();
+		NumberOfSpannedSockets += NewSpan.Vertices.Num();
+	}
+
+	//Only frozen sockets were taken out, so every other list of sockets only moves.
+	for (int SpanIndex = 0; SpanIndex < FrozenSpans.Num() - NewSpans.Num(); SpanIndex++)
+	{
+		FrozenSpans[SpanIndex].SocketIndex = CompactedSockets[FrozenSpans[SpanIndex].SocketIndex];
+	}
+	for (int& EachSocket : ActiveSockets)
+	{
+		EachSocket = CompactedSockets[EachSocket];
+	}
+	for (int& EachSocket : OrderedSockets)
+	{
+		EachSocket = CompactedSockets[EachSocket];
+	}
+
+	Shape = MoveTemp(CompactedShape);
+	SuperPositions = MoveTemp(CompactedSuperPositions);
+	SocketCandidates = MoveTemp(CompactedSocketCandidates);
+	FrozenSockets = MoveTemp(CompactedFrozenSockets);
+	SocketOrders = MoveTemp(CompactedSocketOrders);
+	FrozenSocketsAfterCompaction = Shape.Num() - ActiveSockets.Num();
+
+	UE_LOG(LogTerrainTool, Verbose, TEXT("Took %i frozen sockets out of the frontier in %i spans"), NumberOfSpannedSockets, NewSpans.Num());
+}
+
+/**
+ * Puts the sockets of frozen spans back into the shape. They stay frozen. Must not be called while merges are pending.
+ *
+ * @param SpanIndices - The spans to put back.
+ */
+void FTerrainGenerationWorker::ExpandFrozenSpans(const TArray<int>& SpanIndices)
+{
+	if (SpanIndices.IsEmpty())
+	{
+		return;
+	}
+
+	//The span put back after each socket, if any.
+	TMap<int, int> SocketSpans = TMap<int, int>();
+	int NumberOfVertices = Shape.Num();
+	for (const int EachSpan : SpanIndices)
+	{
+		SocketSpans.Emplace(FrozenSpans[EachSpan].SocketIndex, EachSpan);
+		NumberOfVertices += FrozenSpans[EachSpan].Vertices.Num();
+	}
+
+	//Where each socket is once the spans are put back.
+	TArray<int> ExpandedSockets = TArray<int>();
+	ExpandedSockets.SetNumUninitialized(Shape.Num());
+
+	FTerrainShape ExpandedShape = FTerrainShape();
+	ExpandedShape.Vertices.Reserve(NumberOfVertices);
+	TArray<TArray<TArray<bool>>> ExpandedSuperPositions = TArray<TArray<TArray<bool>>>();
+	ExpandedSuperPositions.Reserve(NumberOfVertices);
+	TArray<FTerrainSocketCandidates> ExpandedSocketCandidates = TArray<FTerrainSocketCandidates>();
+	ExpandedSocketCandidates.Reserve(NumberOfVertices);
+	TBitArray<> ExpandedFrozenSockets = TBitArray<>();
+	TArray<float> ExpandedSocketOrders = TArray<float>();
+
+	for (int SocketIndex = 0; SocketIndex < Shape.Num(); SocketIndex++)
+	{
+		ExpandedSockets[SocketIndex] = ExpandedShape.Num();
+		ExpandedShape.Vertices.Emplace(Shape.Vertices[SocketIndex]);
+		ExpandedSuperPositions.Emplace(MoveTemp(SuperPositions[SocketIndex]));
+		ExpandedSocketCandidates.Emplace(MoveTemp(SocketCandidates[SocketIndex]));
+		ExpandedFrozenSockets.Add(FrozenSockets[SocketIndex]);
+		if (!SocketOrders.IsEmpty())
+		{
+			ExpandedSocketOrders.Emplace(SocketOrders[SocketIndex]);
+		}
+
+		if (const int* SpanIndex = SocketSpans.Find(SocketIndex))
+		{
+			const FTerrainFrozenSpan& Span = FrozenSpans[*SpanIndex];
+			const int NumberOfSpannedVertices = Span.Vertices.Num();
+			ExpandedShape.Vertices.Last().Type = Span.SocketType;
+			ExpandedShape.Vertices.Append(Span.Vertices);
+			ExpandedSuperPositions.AddDefaulted(NumberOfSpannedVertices);
+			for (int SpannedIndex = 0; SpannedIndex < NumberOfSpannedVertices; SpannedIndex++)
+			{
+				ExpandedSocketCandidates.Emplace(FTerrainSocketCandidates::MakeFrozen());
+			}
+			ExpandedFrozenSockets.Add(true, NumberOfSpannedVertices);
+			if (!SocketOrders.IsEmpty())
+			{
+				ExpandedSocketOrders.AddZeroed(NumberOfSpannedVertices);
+			}
+		}
+	}
+
+	TArray<int> SortedSpanIndices = SpanIndices;
+	SortedSpanIndices.Sort();
+	for (int SortedIndex = SortedSpanIndices.Num() - 1; SortedIndex >= 0; SortedIndex--)
+	{
+		FrozenSpans.RemoveAt(SortedSpanIndices[SortedIndex]);
+	}
+
+	for (FTerrainFrozenSpan& EachSpan : FrozenSpans)
+	{
+		EachSpan.SocketIndex = ExpandedSockets[EachSpan.SocketIndex];
+	}
+	for (int& EachSocket : ActiveSockets)
+	{
+		EachSocket = ExpandedSockets[EachSocket];
+	}
+	for (int& EachSocket : OrderedSockets)
+	{
+		EachSocket = ExpandedSockets[EachSocket];
+	}
+
+	Shape = MoveTemp(ExpandedShape);
+	SuperPositions = MoveTemp(ExpandedSuperPositions);
+	SocketCandidates = MoveTemp(ExpandedSocketCandidates);
+	FrozenSockets = MoveTemp(ExpandedFrozenSockets);
+	SocketOrders = MoveTemp(ExpandedSocketOrders);
+}
+
+/**
+ * Puts back the frozen spans that an active socket has come within half a margin of, before a merge can look past their ends.
+ */
+void FTerrainGenerationWorker::ExpandFrozenSpansNearActiveSockets()
+{
+	if (FrozenSpans.IsEmpty())
+	{
+		return;
+	}
+
+	const int ReachMargin = GetFrozenSpanMargin() / 2;
+	TArray<int> NearSpans = TArray<int>();
+	for (int SpanIndex = 0; SpanIndex < FrozenSpans.Num(); SpanIndex++)
+	{
+		const int SpanSocket = FrozenSpans[SpanIndex].SocketIndex;
+		for (int Offset = 1; Offset <= FMath::Min(ReachMargin, Shape.Num() / 2); Offset++)
+		{
+			if (!FrozenSockets[UPTTMath::Mod(SpanSocket + Offset, Shape.Num())] || !FrozenSockets[UPTTMath::Mod(SpanSocket - Offset, Shape.Num())])
+			{
+				NearSpans.Emplace(SpanIndex);
+				break;
+			}
+		}
+	}
+	ExpandFrozenSpans(NearSpans);
+}
+
+/**
+ * Determines whether the mode whose bounds are frozen keeps its sockets sorted.
+ *
+ * @return Whether or not OrderedSockets is maintained.
+ */
+bool FTerrainGenerationWorker::UsesSocketOrder() const
+{
+	return FrozenBounds.IsValid() && FrozenBounds->UsesSocketOrder();
+}
+
+/**
+ * Sorts every active socket by the socket order of the mode whose bounds are frozen.
+ */
+void FTerrainGenerationWorker::RebuildOrderedSockets()
+{
+	OrderedSockets.Reset();
+	SocketOrders.Reset();
+	if (!UsesSocketOrder())
+	{
+		return;
+	}
+
+	const FTerrainCollapseContext Context = FTerrainCollapseContext(Shape, SuperPositions, SocketCandidates, ActiveSockets, OrderedSockets, TileCatalog);
+	SocketOrders.SetNumZeroed(Shape.Num());
+	for (const int SocketIndex : ActiveSockets)
+	{
+		SocketOrders[SocketIndex] = FrozenBounds->GetSocketOrder(Context, SocketIndex);
+	}
+
+	OrderedSockets = ActiveSockets;
+	OrderedSockets.StableSort([&](const int A, const int B) { return SocketOrders[A] < SocketOrders[B]; });
+}
+
+/**
+ * Moves the ordered sockets to where the merges since the last refresh moved them and inserts the refreshed sockets in order. Sockets that were not refreshed keep their order, so the sockets stay sorted.
+ *
+ * @param MovedSockets - Where each socket of the shape before the merges has moved to, or INDEX_NONE if it was removed.
+ * @param StaleSockets - The sockets that were refreshed.
+ */
+void FTerrainGenerationWorker::UpdateOrderedSockets(const TArray<int>& MovedSockets, const TBitArray<>& StaleSockets)
+{
+	if (!UsesSocketOrder())
+	{
+		OrderedSockets.Reset();
+		SocketOrders.Reset();
+		return;
+	}
+
+	TArray<float> NewSocketOrders = TArray<float>();
+	NewSocketOrders.SetNumZeroed(Shape.Num());
+	int NumberKept = 0;
+	for (const int EachSocket : OrderedSockets)
+	{
+		const int MovedSocket = MovedSockets.IsValidIndex(EachSocket) ? MovedSockets[EachSocket] : INDEX_NONE;
+		if (MovedSocket != INDEX_NONE && !StaleSockets[MovedSocket])
+		{
+			NewSocketOrders[MovedSocket] = SocketOrders[EachSocket];
+			OrderedSockets[NumberKept++] = MovedSocket;
+		}
+	}
+	OrderedSockets.SetNum(NumberKept, false);
+
+	const FTerrainCollapseContext Context = FTerrainCollapseContext(Shape, SuperPositions, SocketCandidates, ActiveSockets, OrderedSockets, TileCatalog);
+	for (TConstSetBitIterator<> StaleSocket(StaleSockets); StaleSocket; ++StaleSocket)
+	{
+		const int SocketIndex = StaleSocket.GetIndex();
+		if (!FrozenSockets[SocketIndex])
+		{
+			NewSocketOrders[SocketIndex] = FrozenBounds->GetSocketOrder(Context, SocketIndex);
+			OrderedSockets.Insert(SocketIndex, Algo::UpperBoundBy(OrderedSockets, NewSocketOrders[SocketIndex], [&](const int EachSocket) { return NewSocketOrders[EachSocket]; }));
+		}
+	}
+	SocketOrders = MoveTemp(NewSocketOrders);
+}
+
+/**
+ * Determines whether a superposition is possible in the superpositions last refreshed.
+ *
+ * @param Index - X = Socket to connect to, Y = Tile to add, Z = Socket on tile to connect to.
+ * @return Whether or not the superposition is possible.
+ */
+bool FTerrainGenerationWorker::IsSuperPositionPossible(const FIntVector Index) const
+{
+	return SuperPositions.IsValidIndex(Index.X) && SuperPositions[Index.X].IsValidIndex(Index.Y) && SuperPositions[Index.X][Index.Y].IsValidIndex(Index.Z) && SuperPositions[Index.X][Index.Y][Index.Z];
 }
 
 /**
@@ -364,19 +2949,52 @@ bool FTerrainGenerationWorker::CollapseSuperPosition(FIntVector Index)
  * @param NewShape - The shape to query.
  * @param MergeResult - The result of the merge that most recently happened.
  * @param SeachDeapth - How many iterations into the future to search.
+ * @param InspectedBefore - How many vertices before the first merged vertex the search inspected.
+ * @param InspectedAfter - How many vertices after the last merged vertex the search inspected.
  */
-bool FTerrainGenerationWorker::HasNewCollapseableSuperPositions(FTerrainShape NewShape, FTerrainShapeMergeResult MergeResult, int SearchDepth) const
+bool FTerrainGenerationWorker::HasNewCollapseableSuperPositions(FTerrainShape NewShape, FTerrainShapeMergeResult MergeResult, int SearchDepth, int& InspectedBefore, int& InspectedAfter) const
 {
+	InspectedBefore = 0;
+	InspectedAfter = 0;
+
+	//Fall back to only checking the affected sockets once the budget is spent.
+	if (SearchDepth > 0 && IsLookaheadBudgetExhausted())
+	{
+		SearchDepth = 0;
+	}
+
+	//The new vertices are at the end of the shape, starting at the first merged vertex, and are followed by the last merged vertex at the start of the shape.
+	const int FirstMergedVertex = NewShape.Num() - MergeResult.Growth;
+	auto RecordInspected = [&](const int UnwrappedSocketIndex, const int ReachBefore, const int ReachAfter)
+	{
+		InspectedBefore = FMath::Max(InspectedBefore, FirstMergedVertex - (UnwrappedSocketIndex - ReachBefore));
+		InspectedAfter = FMath::Max(InspectedAfter, UnwrappedSocketIndex + ReachAfter - NewShape.Num());
+	};
+
 	for (int Offset = 0; Offset < FMath::Min(MergeResult.Growth + 2, NewShape.Num()); Offset++)
 	{
-		int CollapseSocketIndex = UPTTMath::Mod(NewShape.Num() - 1 - MergeResult.Growth + Offset, NewShape.Num());
-		for (int CollapseShapeIndex = 0; CollapseShapeIndex < BaseSuperPositions.Num(); CollapseShapeIndex++)
+		//Cancellation point. The result is discarded once stopped.
+		if (bStopped)
+		{
+			return true;
+		}
+
+		//Any gap a macro tile can fill can also be filled by its tiles one at a time, so only the single tiles are tested.
+		//The socket is counted from the end of the shape, so the start of the shape lies after the new vertices.
+		const int UnwrappedSocketIndex = NewShape.Num() - 1 - MergeResult.Growth + Offset;
+		int CollapseSocketIndex = UPTTMath::Mod(UnwrappedSocketIndex, NewShape.Num());
+		for (int CollapseShapeIndex = 0; CollapseShapeIndex < TileCatalog.NumBaseTiles; CollapseShapeIndex++)
 		{
-			for (int CollapseFaceIndex = 0; CollapseFaceIndex < BaseSuperPositions[CollapseShapeIndex].Num(); CollapseFaceIndex++)
+			for (int CollapseFaceIndex = 0; CollapseFaceIndex < TileCatalog.TileSymmetryPeriods[CollapseShapeIndex]; CollapseFaceIndex++)
 			{
+				LookaheadNodes++;
 				if (SearchDepth == 0)
 				{
-					if (NewShape.MergeShape(CollapseSocketIndex, TileShapes[CollapseShapeIndex], CollapseFaceIndex))
+					int ReachBefore = 0;
+					int ReachAfter = 0;
+					const bool bCanMerge = NewShape.MergeShape(CollapseSocketIndex, TileCatalog.TileShapes[CollapseShapeIndex], CollapseFaceIndex, ReachBefore, ReachAfter);
+					RecordInspected(UnwrappedSocketIndex, ReachBefore, ReachAfter);
+					if (bCanMerge)
 					{
 						goto NextSocket;
 					}
@@ -386,11 +3004,20 @@ bool FTerrainGenerationWorker::HasNewCollapseableSuperPositions(FTerrainShape Ne
 					FTerrainShape CollapsedShape;
 					FTerrainShapeMergeResult CollapsedShapeMergeResult;
 
-					if (NewShape.MergeShape(CollapsedShape, CollapsedShapeMergeResult, CollapseSocketIndex, TileShapes[CollapseShapeIndex], CollapseFaceIndex, false) && HasNewCollapseableSuperPositions(CollapsedShape, CollapsedShapeMergeResult, SearchDepth - 1))
+					bool bCanCollapse = NewShape.MergeShape(CollapsedShape, CollapsedShapeMergeResult, CollapseSocketIndex, TileCatalog.TileShapes[CollapseShapeIndex], CollapseFaceIndex, false) && HasOnlyFillableAngles(CollapsedShape, CollapsedShapeMergeResult);
+					if (bCanCollapse)
+					{
+						int NextInspectedBefore = 0;
+						int NextInspectedAfter = 0;
+						bCanCollapse = HasNewCollapseableSuperPositions(CollapsedShape, CollapsedShapeMergeResult, SearchDepth - 1, NextInspectedBefore, NextInspectedAfter);
+						CollapsedShapeMergeResult.ExtendReach(CollapseSocketIndex, NewShape.Num(), NextInspectedBefore, NextInspectedAfter);
+					}
+					RecordInspected(UnwrappedSocketIndex, CollapsedShapeMergeResult.ReachBefore, CollapsedShapeMergeResult.ReachAfter);
+
+					if (bCanCollapse)
 					{
 						goto NextSocket;
 					}
-					
 				}
 			}
 		}
@@ -405,68 +3032,598 @@ bool FTerrainGenerationWorker::HasNewCollapseableSuperPositions(FTerrainShape Ne
 }
 
 /**
- * Refreshes superpositions after a given change in vertices.
- * 
- * @param ShapeVertexGrowth = The number of new vertices in the shape.
- * @param ShapeVertexShrinkage = The number of old vertices removed from the shape.
- * @param ShapeVertexOffset = The shift in vertex index.
+ * Whether or not every vertex changed by a merge leaves a gap that can still be filled.
+ *
+ * @param MergedShape - The shape after the merge.
+ * @param MergeResult - The result of the merge.
+ * @return Whether or not the merge leaves only fillable gaps.
+ */
+bool FTerrainGenerationWorker::HasOnlyFillableAngles(const FTerrainShape& MergedShape, const FTerrainShapeMergeResult& MergeResult) const
+{
+	if (!Config.Lookahead.bPruneUnfillableAngles || MergedShape.Num() == 0)
+	{
+		return true;
+	}
+
+	//The merged vertex after the new vertices, which closes the loop back to them, is always at the start of the merged shape.
+	if (!TileCatalog.AngleTable.IsFillable(MergedShape.Vertices[0].Angle))
+	{
+		return false;
+	}
+
+	for (int VertexIndex = FMath::Max(MergedShape.Num() - MergeResult.Growth, 1); VertexIndex < MergedShape.Num(); VertexIndex++)
+	{
+		if (!TileCatalog.AngleTable.IsFillable(MergedShape.Vertices[VertexIndex].Angle))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Whether or not the lookahead node budget has been used up for the current refresh.
+ *
+ * @return Whether or not further lookahead should be limited to the sockets directly affected by a merge.
+ */
+bool FTerrainGenerationWorker::IsLookaheadBudgetExhausted() const
+{
+	return Config.Lookahead.NodeBudget > 0 && LookaheadNodes >= Config.Lookahead.NodeBudget;
+}
+
+/**
+ * Moves the superpositions to the sockets recorded by the merges since the last refresh and re-evaluates the stale sockets.
  */
-void FTerrainGenerationWorker::RefreshSuperPositions(int ShapeVertexGrowth, int ShapeVertexShrinkage, int ShapeVertexOffset)
+void FTerrainGenerationWorker::RefreshSuperPositions()
 {
+	if (!bMergesPending)
+	{
+		return;
+	}
+	bMergesPending = false;
+
+	//Nothing merges until the refresh is done, so the pending merges are read in place and keep their allocations for the next ones.
+	const TArray<int>& SourceSockets = PendingSourceSockets;
+	const TArray<int>& MovedSockets = PendingMovedSockets;
+	const TBitArray<>& StaleSockets = PendingStaleSockets;
+
 	//Propagate New Super Positions
 	TArray<TArray<TArray<bool>>> NewSuperPositions = TArray<TArray<TArray<bool>>>();
 	NewSuperPositions.SetNum(Shape.Num());
+	TArray<FTerrainSocketCandidates> NewSocketCandidates = TArray<FTerrainSocketCandidates>();
+	NewSocketCandidates.SetNum(Shape.Num());
+
+	//Sockets whose candidates must be rebuilt.
+	TBitArray<> StaleCandidates = TBitArray<>(false, Shape.Num());
+	TBitArray<> NewFrozenSockets = TBitArray<>(false, Shape.Num());
 
 	for (int SuperPositionIndex = 0; SuperPositionIndex < NewSuperPositions.Num(); SuperPositionIndex++)
 	{
-		if (SuperPositionIndex < SuperPositions.Num() - ShapeVertexShrinkage)
+		if (SourceSockets[SuperPositionIndex] != INDEX_NONE)
 		{
-			NewSuperPositions[SuperPositionIndex] = SuperPositions[UPTTMath::Mod(SuperPositionIndex - ShapeVertexOffset, SuperPositions.Num())];
+			//The old superpositions are replaced below, so they can be moved rather than copied.
+			NewSuperPositions[SuperPositionIndex] = MoveTemp(SuperPositions[SourceSockets[SuperPositionIndex]]);
+			NewSocketCandidates[SuperPositionIndex] = MoveTemp(SocketCandidates[SourceSockets[SuperPositionIndex]]);
+			NewFrozenSockets[SuperPositionIndex] = FrozenSockets[SourceSockets[SuperPositionIndex]];
 		}
 		else
 		{
 			NewSuperPositions[SuperPositionIndex] = BaseSuperPositions;
+			StaleCandidates[SuperPositionIndex] = true;
 		}
 	}
 
+	//A collapse that survived the shallow search and may be searched deeper.
+	struct FLookaheadCandidate
+	{
+		FIntVector Index;
+		FTerrainShape CollapsedShape;
+		FTerrainShapeMergeResult MergeResult;
+	};
+
 	int NumberOfPossibleCollapses = 0;
 	FIntVector CollapseIndex = FIntVector();
+	TArray<TArray<FLookaheadCandidate>> ConstrainedSockets = TArray<TArray<FLookaheadCandidate>>();
+	const int InitialSearchDepth = Config.Lookahead.bAdaptive ? 0 : Config.Lookahead.MaxDepth;
+	LookaheadNodes = 0;
+
+	//The result of re-evaluating a single stale socket.
+	struct FSocketRefresh
+	{
+		int SocketIndex = 0;
+		int SocketOptions = 0;
+		int ReachBefore = 0;
+		int ReachAfter = 0;
+		FIntVector LastCollapseIndex = FIntVector();
+		TArray<FLookaheadCandidate> LookaheadCandidates = TArray<FLookaheadCandidate>();
+		bool bChanged = false;
+		int MacroTileMerges = 0;
+		bool bSkippedMacroTiles = false;
+	};
 
-	for (int Offset = 0; Offset < FMath::Min(ShapeVertexGrowth + 2 * MaxTileVertices, Shape.Num()); Offset++)
+	TArray<FSocketRefresh> SocketRefreshes = TArray<FSocketRefresh>();
+	for (TConstSetBitIterator<> StaleSocket(StaleSockets); StaleSocket; ++StaleSocket)
 	{
-		int CollapseSocketIndex = UPTTMath::Mod(Shape.Num() - MaxTileVertices - ShapeVertexGrowth + Offset, Shape.Num());
-		for (int CollapseShapeIndex = 0; CollapseShapeIndex < BaseSuperPositions.Num(); CollapseShapeIndex++)
+		const int SocketIndex = StaleSocket.GetIndex();
+
+		//Sockets outside of the frozen bounds are never collapsed, so their superpositions are not kept.
+		if (!IsSocketInFrozenBounds(SocketIndex) && SocketIndex != ThawingSocket)
+		{
+			NewFrozenSockets[SocketIndex] = true;
+			NewSuperPositions[SocketIndex].Empty();
+			NewSocketCandidates[SocketIndex] = FTerrainSocketCandidates::MakeFrozen();
+			continue;
+		}
+
+		if (NewFrozenSockets[SocketIndex])
+		{
+			NewFrozenSockets[SocketIndex] = false;
+			NewSuperPositions[SocketIndex] = BaseSuperPositions;
+			StaleCandidates[SocketIndex] = true;
+		}
+		SocketRefreshes.AddDefaulted_GetRef().SocketIndex = SocketIndex;
+	}
+	ThawingSocket = INDEX_NONE;
+
+	//Every socket is evaluated against the same shape and only writes its own superpositions, so sockets far apart on a large frontier can be evaluated at once.
+	//A deep search shares the node budget between sockets, so which sockets it reaches would depend on thread timing. Stay serial to keep the results reproducible.
+	const bool bSharesLookaheadBudget = Config.Lookahead.NodeBudget > 0 && InitialSearchDepth > 0;
+	const bool bRefreshInParallel = Config.bParallelRefresh && !bSharesLookaheadBudget && SocketRefreshes.Num() >= CVarTerrainParallelRefreshSockets.GetValueOnAnyThread();
+	ParallelFor(SocketRefreshes.Num(), [&](int32 RefreshIndex)
 		{
-			for (int CollapseFaceIndex = 0; CollapseFaceIndex < BaseSuperPositions[CollapseShapeIndex].Num(); CollapseFaceIndex++)
+			//Cancellation point. The superpositions are no longer needed once stopped.
+			if (bStopped)
 			{
-				FTerrainShape CollapsedShape;
-				FTerrainShapeMergeResult CollapsedShapeMergeResult;
-				if (Shape.MergeShape(CollapsedShape, CollapsedShapeMergeResult, CollapseSocketIndex, TileShapes[CollapseShapeIndex], CollapseFaceIndex))
+				return;
+			}
+
+			FSocketRefresh& Refresh = SocketRefreshes[RefreshIndex];
+			const int CollapseSocketIndex = Refresh.SocketIndex;
+			const TArray<TArray<bool>> OldSocketSuperPositions = NewSuperPositions[CollapseSocketIndex];
+
+			for (int CollapseShapeIndex = 0; CollapseShapeIndex < BaseSuperPositions.Num(); CollapseShapeIndex++)
+			{
+				//Any gap a macro tile can fill can also be filled by its tiles one at a time, so where no single tile fits, neither does any macro tile. Skip merging them.
+				if (CollapseShapeIndex == TileCatalog.NumBaseTiles && Refresh.SocketOptions == 0)
 				{
-					bool bCanCollapse = HasNewCollapseableSuperPositions(CollapsedShape, CollapsedShapeMergeResult, CollapsePredictionDepth);
-					NewSuperPositions[CollapseSocketIndex][CollapseShapeIndex][CollapseFaceIndex] = bCanCollapse;
-					if (bCanCollapse)
+					for (int MacroTileIndex = CollapseShapeIndex; MacroTileIndex < BaseSuperPositions.Num(); MacroTileIndex++)
 					{
-						NumberOfPossibleCollapses++;
-						CollapseIndex = FIntVector(CollapseSocketIndex, CollapseShapeIndex, CollapseFaceIndex);
+						for (int MacroFaceIndex = 0; MacroFaceIndex < TileCatalog.TileSymmetryPeriods[MacroTileIndex]; MacroFaceIndex++)
+						{
+							NewSuperPositions[CollapseSocketIndex][MacroTileIndex][MacroFaceIndex] = false;
+						}
 					}
+					Refresh.bSkippedMacroTiles = true;
+					break;
 				}
-				else
+
+				for (int CollapseFaceIndex = 0; CollapseFaceIndex < TileCatalog.TileSymmetryPeriods[CollapseShapeIndex]; CollapseFaceIndex++)
 				{
-					NewSuperPositions[CollapseSocketIndex][CollapseShapeIndex][CollapseFaceIndex] = false;
+					if (TileCatalog.IsMacroTile(CollapseShapeIndex))
+					{
+						Refresh.MacroTileMerges++;
+					}
+
+					FTerrainShape CollapsedShape;
+					FTerrainShapeMergeResult CollapsedShapeMergeResult;
+					const bool bCanMerge = Shape.MergeShape(CollapsedShape, CollapsedShapeMergeResult, CollapseSocketIndex, TileCatalog.TileShapes[CollapseShapeIndex], CollapseFaceIndex);
+
+					if (bCanMerge && HasOnlyFillableAngles(CollapsedShape, CollapsedShapeMergeResult))
+					{
+						//The socket depends on every vertex the lookahead inspected, not only those the merge did.
+						int InspectedBefore = 0;
+						int InspectedAfter = 0;
+						bool bCanCollapse = HasNewCollapseableSuperPositions(CollapsedShape, CollapsedShapeMergeResult, InitialSearchDepth, InspectedBefore, InspectedAfter);
+						CollapsedShapeMergeResult.ExtendReach(CollapseSocketIndex, Shape.Num(), InspectedBefore, InspectedAfter);
+						Refresh.ReachBefore = FMath::Max(Refresh.ReachBefore, CollapsedShapeMergeResult.ReachBefore);
+						Refresh.ReachAfter = FMath::Max(Refresh.ReachAfter, CollapsedShapeMergeResult.ReachAfter);
+
+						NewSuperPositions[CollapseSocketIndex][CollapseShapeIndex][CollapseFaceIndex] = bCanCollapse;
+						if (bCanCollapse)
+						{
+							Refresh.SocketOptions++;
+							Refresh.LastCollapseIndex = FIntVector(CollapseSocketIndex, CollapseShapeIndex, CollapseFaceIndex);
+
+							//Only sockets with fewer options than the threshold are searched deeper, so stop keeping shapes once a socket reaches it.
+							if (Config.Lookahead.bAdaptive && Config.Lookahead.MaxDepth > 0)
+							{
+								if (Refresh.SocketOptions < Config.Lookahead.AdaptiveThreshold)
+								{
+									Refresh.LookaheadCandidates.Emplace(FLookaheadCandidate{ Refresh.LastCollapseIndex, MoveTemp(CollapsedShape), CollapsedShapeMergeResult });
+								}
+								else
+								{
+									Refresh.LookaheadCandidates.Empty();
+								}
+							}
+						}
+					}
+					else
+					{
+						NewSuperPositions[CollapseSocketIndex][CollapseShapeIndex][CollapseFaceIndex] = false;
+						Refresh.ReachBefore = FMath::Max(Refresh.ReachBefore, CollapsedShapeMergeResult.ReachBefore);
+						Refresh.ReachAfter = FMath::Max(Refresh.ReachAfter, CollapsedShapeMergeResult.ReachAfter);
+					}
+				}
+			}
+
+			Refresh.bChanged = NewSuperPositions[CollapseSocketIndex] != OldSocketSuperPositions;
+		}, !bRefreshInParallel);
+
+	if (bStopped)
+	{
+		return;
+	}
+
+	//Combine the results in socket order so that they do not depend on how the sockets were scheduled.
+	int MacroTileMerges = 0;
+	int MacroTileSocketsSkipped = 0;
+	for (FSocketRefresh& EachRefresh : SocketRefreshes)
+	{
+		MacroTileMerges += EachRefresh.MacroTileMerges;
+		MacroTileSocketsSkipped += EachRefresh.bSkippedMacroTiles;
+
+		NewSocketCandidates[EachRefresh.SocketIndex].ReachBefore = EachRefresh.ReachBefore;
+		NewSocketCandidates[EachRefresh.SocketIndex].ReachAfter = EachRefresh.ReachAfter;
+
+		if (EachRefresh.bChanged)
+		{
+			StaleCandidates[EachRefresh.SocketIndex] = true;
+		}
+
+		if (EachRefresh.SocketOptions > 0)
+		{
+			NumberOfPossibleCollapses += EachRefresh.SocketOptions;
+			CollapseIndex = EachRefresh.LastCollapseIndex;
+		}
+
+		if (EachRefresh.SocketOptions > 0 && EachRefresh.SocketOptions < Config.Lookahead.AdaptiveThreshold && !EachRefresh.LookaheadCandidates.IsEmpty())
+		{
+			ConstrainedSockets.Emplace(MoveTemp(EachRefresh.LookaheadCandidates));
+		}
+	}
+
+	//Iteratively deepen the search at the most constrained sockets first until the budget runs out.
+	ConstrainedSockets.Sort([](const TArray<FLookaheadCandidate>& A, const TArray<FLookaheadCandidate>& B) { return A.Num() < B.Num(); });
+	for (TArray<FLookaheadCandidate>& EachConstrainedSocket : ConstrainedSockets)
+	{
+		for (int SearchDepth = 1; SearchDepth <= Config.Lookahead.MaxDepth && !EachConstrainedSocket.IsEmpty() && !IsLookaheadBudgetExhausted(); SearchDepth++)
+		{
+			for (int CandidateIndex = EachConstrainedSocket.Num() - 1; CandidateIndex >= 0; CandidateIndex--)
+			{
+				if (bStopped)
+				{
+					return;
+				}
+
+				FLookaheadCandidate& Candidate = EachConstrainedSocket[CandidateIndex];
+				int InspectedBefore = 0;
+				int InspectedAfter = 0;
+				const bool bCanCollapse = HasNewCollapseableSuperPositions(Candidate.CollapsedShape, Candidate.MergeResult, SearchDepth, InspectedBefore, InspectedAfter);
+
+				//The deeper search may have inspected more of the frontier than the shallower ones.
+				Candidate.MergeResult.ExtendReach(Candidate.Index.X, Shape.Num(), InspectedBefore, InspectedAfter);
+				FTerrainSocketCandidates& DeepenedCandidates = NewSocketCandidates[Candidate.Index.X];
+				DeepenedCandidates.ReachBefore = FMath::Max(DeepenedCandidates.ReachBefore, Candidate.MergeResult.ReachBefore);
+				DeepenedCandidates.ReachAfter = FMath::Max(DeepenedCandidates.ReachAfter, Candidate.MergeResult.ReachAfter);
+
+				if (!bCanCollapse)
+				{
+					NewSuperPositions[Candidate.Index.X][Candidate.Index.Y][Candidate.Index.Z] = false;
+					StaleCandidates[Candidate.Index.X] = true;
+					NumberOfPossibleCollapses--;
+					EachConstrainedSocket.RemoveAt(CandidateIndex);
 				}
 			}
 		}
 	}
 
-	SuperPositions = NewSuperPositions;
+	//A pruned candidate may have been the remembered collapse.
+	if (NumberOfPossibleCollapses == 1 && !NewSuperPositions[CollapseIndex.X][CollapseIndex.Y][CollapseIndex.Z])
+	{
+		for (const TArray<FLookaheadCandidate>& EachConstrainedSocket : ConstrainedSockets)
+		{
+			if (!EachConstrainedSocket.IsEmpty())
+			{
+				CollapseIndex = EachConstrainedSocket[0].Index;
+			}
+		}
+	}
+
+	LastRefreshLookaheadNodes = LookaheadNodes.load();
+	PeakRefreshLookaheadNodes = FMath::Max<int>(PeakRefreshLookaheadNodes, LookaheadNodes);
+	UE_LOG(LogTerrainTool, Verbose, TEXT("Refresh tested %i lookahead merges"), LookaheadNodes.load());
+	if (TileCatalog.Num() > TileCatalog.NumBaseTiles)
+	{
+		UE_LOG(LogTerrainTool, Verbose, TEXT("Refresh tested %i macro tile merges at %i sockets and skipped the macro tiles at %i sockets no single tile fits"), MacroTileMerges, SocketRefreshes.Num() - MacroTileSocketsSkipped, MacroTileSocketsSkipped);
+	}
+
+	for (TConstSetBitIterator<> StaleCandidate(StaleCandidates); StaleCandidate; ++StaleCandidate)
+	{
+		NewSocketCandidates[StaleCandidate.GetIndex()].Rebuild(NewSuperPositions[StaleCandidate.GetIndex()], TileCatalog);
+	}
+
+	SuperPositions = MoveTemp(NewSuperPositions);
+	SocketCandidates = MoveTemp(NewSocketCandidates);
+	FrozenSockets = MoveTemp(NewFrozenSockets);
+	UpdateActiveSockets(MovedSockets, StaleSockets);
+	UpdateOrderedSockets(MovedSockets, StaleSockets);
 
-	if (NumberOfPossibleCollapses == 1)
+	//Only a refresh of the whole frontier can tell that a collapse is the only one left, and a batch of a resumed frontier is not. The first step finds it anyway.
+	if (NumberOfPossibleCollapses == 1 && InitializationPhase == ETerrainInitializationPhase::Done)
 	{
+		BeginDecision();
 		CollapseSuperPosition(CollapseIndex);
 	}
+
+	//A refresh cut short leaves the superpositions behind the shape.
+	if (!bStopped && !bMergesPending)
+	{
+		ExpandFrozenSpansNearActiveSockets();
+	}
 }
 
 /* /\ ========================= /\ *\
 |  /\ FTerrainGenerationWorker  /\  |
-\* /\ ========================= /\ */
\ No newline at end of file
+\* /\ ========================= /\ */
+
+
+
+/* \/ ============================ \/ *\
+|  \/ FTerrainGenerationScheduler  \/  |
+\* \/ ============================ \/ */
+
+FTerrainGenerationScheduler* FTerrainGenerationScheduler::Instance = nullptr;
+
+/**
+ * Gets the scheduler shared by all terrain generators. Only valid while the module is loaded.
+ *
+ * @return The shared scheduler.
+ */
+FTerrainGenerationScheduler& FTerrainGenerationScheduler::Get()
+{
+	check(Instance);
+	return *Instance;
+}
+
+/**
+ * Determines whether the module's scheduler exists, which it does not after the module has shut down.
+ *
+ * @return Whether or not Get can be called.
+ */
+bool FTerrainGenerationScheduler::IsAvailable()
+{
+	return Instance != nullptr;
+}
+
+/**
+ * Creates the event used to wake the scheduler's threads. Created by the module when it starts up.
+ */
+FTerrainGenerationScheduler::FTerrainGenerationScheduler() :
+	ThreadCount(CVarTerrainGenerationThreads.GetValueOnAnyThread()),
+	bStopping(false),
+	WorkEvent(FPlatformProcess::GetSynchEventFromPool())
+{
+	check(!Instance);
+	Instance = this;
+}
+
+/**
+ * Stops the threads and releases the workers still waiting when destroyed. Destroyed by the module when it shuts down.
+ */
+FTerrainGenerationScheduler::~FTerrainGenerationScheduler()
+{
+	Shutdown();
+
+	//No thread is running a worker anymore, so the waiting ones can be let go of.
+	{
+		FScopeLock WorkersScopeLock(&WorkersLock);
+		for (FTerrainGenerationWorker* EachWorker : ReadyWorkers)
+		{
+			EachWorker->bScheduled = false;
+			EachWorker->ReleasedEvent->Trigger();
+		}
+		ReadyWorkers.Empty();
+	}
+
+	Instance = nullptr;
+	FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+	WorkEvent = nullptr;
+}
+
+/**
+ * Queues a worker to be given a time slice. The worker must be marked as scheduled.
+ *
+ * @param Worker - The worker with work to do.
+ */
+void FTerrainGenerationScheduler::Schedule(FTerrainGenerationWorker* Worker)
+{
+	{
+		FScopeLock WorkersScopeLock(&WorkersLock);
+		Worker->ReleasedEvent->Reset();
+		ReadyWorkers.Emplace(Worker);
+	}
+
+	StartThreads();
+	WorkEvent->Trigger();
+}
+
+/**
+ * Removes a worker waiting for a time slice.
+ *
+ * @param Worker - The worker to remove.
+ */
+void FTerrainGenerationScheduler::Unschedule(FTerrainGenerationWorker* Worker)
+{
+	FScopeLock WorkersScopeLock(&WorkersLock);
+	if (ReadyWorkers.Remove(Worker) > 0)
+	{
+		Worker->bScheduled = false;
+		Worker->ReleasedEvent->Trigger();
+	}
+}
+
+/**
+ * Determines whether a worker is waiting for or running a time slice.
+ *
+ * @param Worker - The worker to query.
+ * @return Whether or not the worker is waiting for or running a time slice.
+ */
+bool FTerrainGenerationScheduler::IsScheduled(FTerrainGenerationWorker* Worker) const
+{
+	FScopeLock WorkersScopeLock(&WorkersLock);
+	return ReadyWorkers.Contains(Worker) || RunningWorkers.Contains(Worker);
+}
+
+/**
+ * Replaces the scheduler's threads. Waits for the current time slices to end.
+ *
+ * @param NewThreadCount - The number of threads to run workers on. 0 picks a count based on the number of cores.
+ */
+void FTerrainGenerationScheduler::SetThreadCount(const int NewThreadCount)
+{
+	{
+		FScopeLock ThreadsScopeLock(&ThreadsLock);
+		ThreadCount = NewThreadCount;
+	}
+	Shutdown();
+
+	bool bHasReadyWorkers;
+	{
+		FScopeLock WorkersScopeLock(&WorkersLock);
+		bHasReadyWorkers = !ReadyWorkers.IsEmpty();
+	}
+
+	//Otherwise the threads are started by the next worker to be scheduled.
+	if (bHasReadyWorkers)
+	{
+		StartThreads();
+	}
+}
+
+/**
+ * Stops all of the scheduler's threads until the next worker is scheduled.
+ */
+void FTerrainGenerationScheduler::Shutdown()
+{
+	FScopeLock ThreadsScopeLock(&ThreadsLock);
+
+	Stop();
+	for (FRunnableThread* EachThread : Threads)
+	{
+		delete EachThread;
+	}
+	Threads.Empty();
+}
+
+/**
+ * Repeatedly gives the next waiting worker a time slice.
+ *
+ * @return 0
+ */
+uint32 FTerrainGenerationScheduler::Run()
+{
+	while (!bStopping)
+	{
+		FTerrainGenerationWorker* Worker = DequeueWorker();
+		if (Worker)
+		{
+			const double SliceDuration = CVarTerrainGenerationTimeSlice.GetValueOnAnyThread() / 1000.0 * Worker->Priority;
+			FinishSlice(Worker, Worker->RunSlice(SliceDuration));
+		}
+		else
+		{
+			WorkEvent->Wait(100);
+		}
+	}
+
+	//Wake the next thread so that it also sees it should exit.
+	WorkEvent->Trigger();
+	return 0;
+}
+
+/**
+ * Stops all of the scheduler's threads.
+ */
+void FTerrainGenerationScheduler::Stop()
+{
+	bStopping = true;
+	WorkEvent->Trigger();
+}
+
+/**
+ * Starts the threads if they are not already running.
+ */
+void FTerrainGenerationScheduler::StartThreads()
+{
+	FScopeLock ThreadsScopeLock(&ThreadsLock);
+	if (Threads.IsEmpty())
+	{
+		bStopping = false;
+
+		const int NumberOfThreads = ThreadCount > 0 ? ThreadCount : FMath::Max(FPlatformMisc::NumberOfCores() - 1, 1);
+		for (int ThreadIndex = 0; ThreadIndex < NumberOfThreads; ThreadIndex++)
+		{
+			Threads.Emplace(FRunnableThread::Create(this, *FString::Printf(TEXT("FTerrainGenerationScheduler %i"), ThreadIndex), 0, TPri_BelowNormal));
+		}
+	}
+}
+
+/**
+ * Takes the next worker waiting for a time slice and marks it as running.
+ *
+ * @return The next worker, or nullptr if none are waiting.
+ */
+FTerrainGenerationWorker* FTerrainGenerationScheduler::DequeueWorker()
+{
+	FScopeLock WorkersScopeLock(&WorkersLock);
+	if (ReadyWorkers.IsEmpty())
+	{
+		return nullptr;
+	}
+
+	FTerrainGenerationWorker* Worker = ReadyWorkers[0];
+	ReadyWorkers.RemoveAt(0);
+	RunningWorkers.Emplace(Worker);
+
+	//Wake another thread for the next waiting worker.
+	if (!ReadyWorkers.IsEmpty())
+	{
+		WorkEvent->Trigger();
+	}
+	return Worker;
+}
+
+/**
+ * Requeues or releases a worker after its time slice.
+ *
+ * @param Worker - The worker that was run.
+ * @param bHasMoreWork - Whether or not the worker still needs more time.
+ */
+void FTerrainGenerationScheduler::FinishSlice(FTerrainGenerationWorker* Worker, const bool bHasMoreWork)
+{
+	FScopeLock WorkersScopeLock(&WorkersLock);
+	RunningWorkers.Remove(Worker);
+
+	//Requeue at the back so that every waiting worker gets a turn first.
+	if (bHasMoreWork)
+	{
+		ReadyWorkers.Emplace(Worker);
+		return;
+	}
+
+	Worker->bScheduled = false;
+
+	//A command may have been queued after the slice ended but before the worker was released.
+	if (Worker->HasWork() && !Worker->bScheduled.exchange(true))
+	{
+		ReadyWorkers.Emplace(Worker);
+		return;
+	}
+
+	Worker->ReleasedEvent->Trigger();
+}
+
+/* /\ ============================ /\ *\
+|  /\ FTerrainGenerationScheduler  /\  |
+\* /\ ============================ /\ */
\ No newline at end of file
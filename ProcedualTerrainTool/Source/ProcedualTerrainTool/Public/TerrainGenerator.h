@@ -5,7 +5,11 @@
 #include "CoreMinimal.h"
 
 #include "TerrainShape.h"
+#include "TerrainAngleTable.h"
 #include "HAL/Runnable.h"
+#include "Containers/Queue.h"
+#include "HAL/CriticalSection.h"
+#include "Async/Future.h"
 
 #include "GameFramework/Actor.h"
 #include "TerrainGenerator.generated.h"
@@ -15,6 +19,25 @@ DECLARE_LOG_CATEGORY_EXTERN(LogTerrainTool, Log, All);
 class UTerrainTileData;
 class UProcedualCollapseMode;
 class UManualCollapseMode;
+struct FTerrainCollapseModeConfig;
+
+//An immutable copy of a collapse mode's settings that can be shared with the worker.
+typedef TSharedPtr<const FTerrainCollapseModeConfig, ESPMode::ThreadSafe> FTerrainCollapseModeConfigPtr;
+
+
+/**
+ * The schedule used to decide how long a generation attempt may go without progress before it is restarted.
+ */
+UENUM(BlueprintType)
+enum class ETerrainRestartSchedule : uint8
+{
+	//Only restart after the generation fails outright.
+	None		UMETA(DisplayName = "None"),
+	//Stall budgets follow the Luby sequence (1, 1, 2, 1, 1, 2, 4, ...) scaled by the restart unit time.
+	Luby		UMETA(DisplayName = "Luby"),
+	//Stall budgets grow by a constant factor after every restart.
+	Geometric	UMETA(DisplayName = "Geometric"),
+};
 
 
 /* \/ ========================= \/ *\
@@ -89,248 +112,1669 @@ struct PROCEDUALTERRAINTOOL_API FTerrainTileSpawnData
 
 
 
-/* \/ ================== \/ *\
-|  \/ ATerrainGenerator  \/  |
-\* \/ ================== \/ */
+/* \/ ======================= \/ *\
+|  \/ FTerrainMacroTileGroup  \/  |
+\* \/ ======================= \/ */
 
 /**
- * A tool for generating terrain. Takes in a set of tiles and can connect them together to form terrain.
+ * A group of spawnable tiles to fit together and place as a single macro tile.
  */
-UCLASS()
-class PROCEDUALTERRAINTOOL_API ATerrainGenerator : public AActor
+USTRUCT(BlueprintType)
+struct PROCEDUALTERRAINTOOL_API FTerrainMacroTileGroup
 {
 	GENERATED_BODY()
 
-public:
-	/**
-	 * Sets up the root component.
-	 */
-	ATerrainGenerator();
-
-	/**
-	 * Temporary function that can be used to debug the terrain generator.
-	 */
-	UFUNCTION(/*CallInEditor, BlueprintCallable,*/ Meta = (Category = "Terrain Generator"))
-	void Test();
+	//The indices of the spawnable tiles in the group, in the order they are fitted together. Each tile is attached to the tiles before it.
+	UPROPERTY(EditAnywhere, Meta = (Category = "Tile Data"))
+	TArray<int> TileIndices;
 
-	/**
-	 * Begins the terrain generation process.
-	 */
-	UFUNCTION(CallInEditor, BlueprintCallable, Meta = (Category = "Terrain Generator"))
-	void BeginGeneration();
+	//How likely this group is to spawn relative to the other macro tiles. Macro tiles found by sampling have weights from 0 to 1, with 1 for the cluster found most often.
+	UPROPERTY(EditAnywhere, Meta = (ClampMin = "0", Category = "Tile Data"))
+	float SpawnWeight = 1;
 
 	/**
-	 * Stops the generation before the terrain is finished generating.
+	 * Initializes a FTerrainMacroTileGroup.
 	 */
-	UFUNCTION(CallInEditor, BlueprintCallable, Meta = (Category = "Terrain Generator"))
-	void EndGeneration();
+	FTerrainMacroTileGroup()
+	{
 
-	/**
-	 * Resets the generation process and deletes all actors already spawned.
-	 */
-	UFUNCTION(CallInEditor, BlueprintCallable, Meta = (Category = "Terrain Generator"))
-	void Reset();
+	}
 
+	bool operator==(const FTerrainMacroTileGroup& OtherGroup) const
+	{
+		return TileIndices == OtherGroup.TileIndices && SpawnWeight == OtherGroup.SpawnWeight;
+	}
+};
 
-	//The set of tiles that this will use when generating terrain.
-	UPROPERTY(EditAnywhere, Meta = (Category = "Terrain Generator"))
-	TArray<FTerrainTileSpawnData> SpawnableTiles;
+/* /\ ======================= /\ *\
+|  /\ FTerrainMacroTileGroup  /\  |
+\* /\ ======================= /\ */
 
-	//The method and shape in which the terrain will be generated.
-	UPROPERTY(EditAnywhere, Instanced, Meta = (Category = "Terrain Generator"))
-	UProcedualCollapseMode* GenerationMode = nullptr;
 
-	//The method and shape in which the terrain will be generated.
-	UPROPERTY(EditAnywhere, Meta = (Category = "Terrain Generator"))
-	bool bGenerateUntilSuccessful = false;
 
-	//How many steps into the future to look when generating terrain. Higher numbers slow generation but reduce risk of generation failure.
-	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0", ClampMax = "4", Category = "Terrain Generator"))
-	int PredictionDepth = 0;
+/* \/ ===================== \/ *\
+|  \/ FTerrainTileCatalog  \/  |
+\* \/ ===================== \/ */
 
-	//Whether or not to use the manually entered seed when generating terrain.
-	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator", EditCondition = "!bGenerateUntilSuccessful"))
-	bool bUseManualSeed = false;
+/**
+ * The geometry and weight of a spawnable tile, copied out of its tile data so that it can be compiled off the game thread.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainTileDefinition
+{
+	//The vertices of the 2D bounds of the tile.
+	TArray<FVector2D> Verticies = TArray<FVector2D>();
 
-	//Whether or not to use the manually entered seed when generating terrain.
-	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator", EditCondition = "!bGenerateUntilSuccessful && bUseManualSeed"))
-	FRandomStream Seed = FRandomStream(0);
+	//The type of each face of the bounds of the tile.
+	TArray<FName> FaceTypes = TArray<FName>();
 
-private:
+	//How likely the tile is to spawn.
+	float SpawnWeight = 1;
 
 	/**
-	 * Spawns any new tiles created by the worker and shuts down worker if complete.
+	 * Constructs an empty definition.
 	 */
-	UFUNCTION(Meta = (Category = "Terrain Generator"))
-	void RefreshTiles();
+	FTerrainTileDefinition()
+	{
+
+	}
 
 	/**
-	 * Spawns a single tile.
-	 * 
-	 * @param TileData - The data needed to know where and what to spawn.
+	 * Copies the definition of a spawnable tile. Must be called on the game thread.
+	 *
+	 * @param SpawnData - The tile to copy. Must have valid tile data.
 	 */
-	UFUNCTION()
-	void SpawnTile(FTerrainTileInstanceData TileData);
+	FTerrainTileDefinition(const FTerrainTileSpawnData& SpawnData);
 
-	//An asynchronous worker used to collapse superpositions and generate terrain without freezing the editor.
-	class FTerrainGenerationWorker* TerrainGenerationWorker;
+	bool operator==(const FTerrainTileDefinition& OtherDefinition) const
+	{
+		return Verticies == OtherDefinition.Verticies && FaceTypes == OtherDefinition.FaceTypes && SpawnWeight == OtherDefinition.SpawnWeight;
+	}
+};
 
-	//The current shape of the terrain.
-	UPROPERTY()
-	FTerrainShape TerrainShape = FTerrainShape();
+/**
+ * How a FTerrainTileCatalog finds clusters of tiles to place as single macro tiles.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainMacroTileSettings
+{
+	//The most clusters found by sampling random fits of the tiles. 0 disables sampling.
+	int SampledClusters = 0;
+	//The most tiles in a sampled cluster.
+	int MaxClusterSize = 4;
+	//Clusters of spawnable tiles chosen by the user.
+	TArray<FTerrainMacroTileGroup> Groups = TArray<FTerrainMacroTileGroup>();
+
+	bool operator==(const FTerrainMacroTileSettings& OtherSettings) const
+	{
+		return SampledClusters == OtherSettings.SampledClusters && MaxClusterSize == OtherSettings.MaxClusterSize && Groups == OtherSettings.Groups;
+	}
+};
 
-	//The timer that periodically updates the tiles to match the worker.
-	UPROPERTY()
-	FTimerHandle TileRefreshTimerHandle;
+/**
+ * One of the tiles a macro tile is made of.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainMacroTileMember
+{
+	//The solver tile of the member.
+	int SolverTileIndex = 0;
+	//The spawnable tile to place for the member, or INDEX_NONE if any variant may be placed.
+	int PreferredVariant = INDEX_NONE;
+	//The transform from the member's own space to the macro tile's space.
+	FTransform2D Transform = FTransform2D();
+};
 
-	//The number of tiles currently spawned.
-	UPROPERTY()
-	int NumberOfTilesSpawned = 0;
+/**
+ * A set of spawnable tiles compiled for the solver. Tiles with identical geometry are grouped into a single solver tile. Clusters of tiles placed as one are appended after them as macro tiles.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainTileCatalog
+{
+	//The shape of each solver tile.
+	TArray<FTerrainShape> TileShapes = TArray<FTerrainShape>();
 
-	//All of the actors spawned by this.
-	UPROPERTY()
-	TSet<AActor*> TileActors = TSet<AActor*>();
-};
+	//The combined spawn weight of each solver tile's variants.
+	TArray<float> TileWeights = TArray<float>();
 
-/* /\ ================== /\ *\
-|  /\ ATerrainGenerator  /\  |
-\* /\ ================== /\ */
+	//The area of each solver tile.
+	TArray<double> TileAreas = TArray<double>();
 
+	//The rotational period of each solver tile. Only the first period of faces are evaluated as the rest produce the same merges.
+	TArray<int> TileSymmetryPeriods = TArray<int>();
 
-/* \/ ========================= \/ *\
-|  \/ FTerrainGenerationWorker  \/  |
-\* \/ ========================= \/ */
+	//The indices of the spawnable tiles that share each solver tile's geometry.
+	TArray<TArray<int>> TileVariants = TArray<TArray<int>>();
+
+	//The index of the solver tile of each spawnable tile.
+	TArray<int> SolverTileIndices = TArray<int>();
+
+	//The spawn weight of each spawnable tile.
+	TArray<float> VariantWeights = TArray<float>();
+
+	//The largest number of vertices of any single tile. Bounds how far along the frontier a lookahead merge of a single tile can look.
+	int MaxTileVertices = 0;
+
+	//The number of solver tiles compiled from single spawnable tiles. Every solver tile after these is a macro tile.
+	int NumBaseTiles = 0;
+
+	//The tiles each macro tile is made of. Empty for solver tiles that are not macro tiles.
+	TArray<TArray<FTerrainMacroTileMember>> TileMembers = TArray<TArray<FTerrainMacroTileMember>>();
+
+	//The gaps that can be filled by the corners of the tiles.
+	FTerrainAngleTable AngleTable = FTerrainAngleTable();
 
-/**
- * Asynchronously generates terrain out of a given set of tiles.
- */
-class FTerrainGenerationWorker : public FRunnable
-{
-public:
 	/**
-	 * Gets the results of the superposition collapses.
-	 * 
-	 * @return The results of the superposition collapses.
+	 * Constructs an empty catalog.
 	 */
-	TArray<FTerrainTileInstanceData> GetTerrainTiles()
+	FTerrainTileCatalog()
 	{
-		return TerrainTiles;
+
 	}
 
 	/**
-	 * Gets the current shape of the terrain.
-	 * 
-	 * @return The current shape of the terrain.
+	 * Compiles the given tiles into solver tiles, then fits together the user defined macro tile groups. The sampled macro tiles are added by SampleMacroTiles.
+	 *
+	 * @param TileDefinitions - The definitions of the spawnable tiles to compile.
+	 * @param MacroTileSettings - How to find the macro tiles.
+	 */
+	FTerrainTileCatalog(const TArray<FTerrainTileDefinition>& TileDefinitions, const FTerrainMacroTileSettings& MacroTileSettings = FTerrainMacroTileSettings());
+
+	/**
+	 * Grows random clusters of the single tiles until enough have been grown or the deadline passes. Once enough have been grown, adds the ones found most often as macro tiles.
+	 *
+	 * @param MacroTileSettings - How many clusters to keep and how large they may be. Must be the settings the catalog was compiled with.
+	 * @param Deadline - When to stop growing clusters, in platform seconds. At least one cluster is always grown.
+	 * @return Whether or not the macro tiles have been added.
+	 */
+	bool SampleMacroTiles(const FTerrainMacroTileSettings& MacroTileSettings, const double Deadline);
+
+	/**
+	 * Gets the number of solver tiles.
+	 *
+	 * @return The number of solver tiles.
 	 */
-	FTerrainShape GetTerrainShape()
+	int Num() const
 	{
-		return Shape;
+		return TileShapes.Num();
 	}
 
 	/**
-	 * Determines whether the terrain is finished generating.
+	 * Chooses which spawnable tile to place for a solver tile by weight.
 	 *
-	 * @return Whether or not the terrain is finished generating.
+	 * @param SolverTileIndex - The solver tile being placed.
+	 * @param RandomStream - The random stream used to choose.
+	 * @param PreferredVariant - A spawnable tile to place if it shares the solver tile's geometry.
+	 * @return The index of the spawnable tile to place.
 	 */
-	bool IsTerrainFinishedGenerating();
+	int ChooseVariant(const int SolverTileIndex, FRandomStream& RandomStream, const int PreferredVariant = INDEX_NONE) const;
 
 	/**
-	 * Creates a FTerrainGenerationWorker able to compute superposition collapses of the given tiles.
+	 * Determines whether a solver tile is a cluster of tiles placed as one.
 	 *
-	 * @param UseableTiles - The tiles that will be used to generate the terrain.
-	 * @param Mode - The method used for deciding which superposition to collapse next.
-	 * @param PredictionDepth - How many iterations into the future to search for failed superpositions.
+	 * @param SolverTileIndex - The solver tile to check.
+	 * @return Whether or not the solver tile is a macro tile.
 	 */
-	FTerrainGenerationWorker(TArray<FTerrainTileSpawnData> Tiles, UProcedualCollapseMode* Mode, FRandomStream& RandomStream, const int PredictionDepth = 0, FTerrainShape CurrentTerrainShape = FTerrainShape());
+	bool IsMacroTile(const int SolverTileIndex) const
+	{
+		return SolverTileIndex >= NumBaseTiles;
+	}
 
 	/**
-	 * Destructs this and handles thread deletion.
+	 * Finds a catalog already compiled from the same tiles and settings, so that restarted and repeated generations do not sample the clusters again.
+	 *
+	 * @param TileDefinitions - The definitions of the spawnable tiles.
+	 * @param MacroTileSettings - How the macro tiles are found.
+	 * @return The compiled catalog, or null if none has been compiled from them recently.
 	 */
-	virtual ~FTerrainGenerationWorker();
+	static TSharedPtr<const FTerrainTileCatalog, ESPMode::ThreadSafe> FindCompiled(const TArray<FTerrainTileDefinition>& TileDefinitions, const FTerrainMacroTileSettings& MacroTileSettings);
 
+	/**
+	 * Keeps a fully compiled catalog to be found by later generations. Only the most recently compiled catalogs are kept.
+	 *
+	 * @param TileDefinitions - The definitions of the spawnable tiles the catalog was compiled from.
+	 * @param MacroTileSettings - How the catalog's macro tiles were found.
+	 * @param Catalog - The compiled catalog. Its macro tiles must have been sampled.
+	 */
+	static void AddCompiled(const TArray<FTerrainTileDefinition>& TileDefinitions, const FTerrainMacroTileSettings& MacroTileSettings, const FTerrainTileCatalog& Catalog);
 
-	// \/ Begin FRunnable interface. \/ //
+private:
+	//A cluster found by sampling, along with how often it was found.
+	struct FSampledCluster
+	{
+		FTerrainShape Shape;
+		TArray<FTerrainMacroTileMember> Members;
+		int Count = 0;
+	};
+
+	//The clusters grown so far. Clusters with the same tiles and outline are the same cluster, however they were grown.
+	TMap<uint64, FSampledCluster> SampledClusters = TMap<uint64, FSampledCluster>();
+
+	//The random stream clusters are grown with. Always seeded the same so that the catalog does not depend on the seed.
+	FRandomStream ClusterStream = FRandomStream(0);
+
+	//The number of clusters grown so far.
+	int NumberOfSamplesTaken = 0;
+
+	//Whether or not the sampled clusters have been added as macro tiles.
+	bool bMacroTilesSampled = false;
 
 	/**
-	 * Begins the process of terrain generation.
-	 * 
-	 * @return true
+	 * Fits together the tiles of each user defined group and adds them as macro tiles.
+	 *
+	 * @param MacroTileSettings - The groups to fit together.
 	 */
-	virtual bool Init();
+	void AssembleMacroTileGroups(const FTerrainMacroTileSettings& MacroTileSettings);
 
 	/**
-	 * Repeatedly collapses superpositions in order to generate the terrain.
-	 * 
-	 * @return 0
+	 * Attaches a single tile to a face of a cluster, leaving only gaps the single tiles can fill.
+	 *
+	 * @param ClusterShape - The outline of the cluster. Set to the merged outline if the tile was attached.
+	 * @param Members - The tiles of the cluster. The new tile is added if it was attached.
+	 * @param SolverTileIndex - The single tile to attach.
+	 * @param PreferredVariant - The spawnable tile to place for the new member, or INDEX_NONE if any variant may be placed.
+	 * @param RandomStream - The random stream used to choose where to attach the tile.
+	 * @param MaxAttempts - The most faces to try. Every face is tried if 0.
+	 * @return Whether or not the tile was attached.
 	 */
-	virtual uint32 Run();
+	bool AttachMacroTileMember(FTerrainShape& ClusterShape, TArray<FTerrainMacroTileMember>& Members, const int SolverTileIndex, const int PreferredVariant, FRandomStream& RandomStream, const int MaxAttempts) const;
 
 	/**
-	 * Stops the generation process regardless of completion.
+	 * Adds a cluster of single tiles as a macro tile.
+	 *
+	 * @param ClusterShape - The outline of the cluster.
+	 * @param Members - The tiles of the cluster.
+	 * @param Weight - How likely the macro tile is to spawn relative to the other macro tiles.
 	 */
-	virtual void Stop();
+	void AddMacroTile(const FTerrainShape& ClusterShape, const TArray<FTerrainMacroTileMember>& Members, const float Weight);
+};
 
-	// /\  End FRunnable interface.  /\ //
+/* /\ ===================== /\ *\
+|  /\ FTerrainTileCatalog  /\  |
+\* /\ ===================== /\ */
 
-private:
-	//Thread to run the worker FRunnable on 
-	FRunnableThread* Thread;
-	//Whether or not the task has been stopped prematurely.
-	std::atomic_bool bStopped;
 
 
-	//The method used for deciding which superposition to collapse next.
-	UProcedualCollapseMode* CollapseMode;
-	//The random stream used to generate the terrain.
-	FRandomStream& RandomStream;
-	//How many iterations into the future to search for failed superpositions.
-	int CollapsePredictionDepth;
-	//The tiles that will be used to generate the terrain.
-	TArray<FTerrainTileSpawnData> UseableTiles;
-	//The shapes of the tiles.
-	TArray<FTerrainShape> TileShapes;
-	//The shapes of the tiles.
-	int MaxTileVertices;
-	//The superposition of an empty socket.
-	TArray<TArray<bool>> BaseSuperPositions;
+/* \/ ========================== \/ *\
+|  \/ FTerrainSocketCandidates  \/  |
+\* \/ ========================== \/ */
+
+/**
+ * The collapses still possible at a socket along with an alias table over their weights, so that one can be chosen by weight in constant time.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainSocketCandidates
+{
+	//The solver tile and face of each possible collapse.
+	TArray<FIntPoint> Candidates = TArray<FIntPoint>();
 
+	//The chance of keeping each column of the alias table rather than taking its alias.
+	TArray<float> Probabilities = TArray<float>();
 
-	//Will be written to as superpositions are collapsed.
-	TArray<FTerrainTileInstanceData> TerrainTiles;
-	//The current shape of the terrain.
-	FTerrainShape Shape;
-	//Whether or not a given tile can connect to a given socket. SuperPositions[Socket to connect to][Tile to add][Socket on tile to connect to].
-	TArray<TArray<TArray<bool>>> SuperPositions = TArray<TArray<TArray<bool>>>();
-	//Whether or not the task is complete.
-	bool bCompleated;
+	//The candidate taken when a column of the alias table is not kept.
+	TArray<int> Aliases = TArray<int>();
+
+	//How many vertices before the socket the merges and lookahead tested at it depend on. A merge that changes none of them leaves the candidates unchanged.
+	int ReachBefore = 0;
+
+	//How many vertices after the socket the merges and lookahead tested at it depend on.
+	int ReachAfter = 0;
 
 	/**
-	 * Attempts to collapse a super position at a given index. 
-	 * 
-	 * @param Index - X = Socket to connect to, Y = Tile to add, Z = Socket on tile to connect to.
-	 * @return Whether or not the collapse was successful.
+	 * Rebuilds the candidates and alias table from the superpositions of a socket. Only keeps the macro tiles if any of them fit. Reuses the existing allocations.
+	 *
+	 * @param SocketSuperPositions - The superposition states of the socket. Indexed by solver tile, then face.
+	 * @param TileCatalog - The solver tiles that can be spawned.
 	 */
-	bool CollapseSuperPosition(FIntVector Index);
+	void Rebuild(const TArray<TArray<bool>>& SocketSuperPositions, const FTerrainTileCatalog& TileCatalog);
 
 	/**
-	 * Whether or not there is an available super position to collapse after the given merge.
-	 * 
-	 * @param NewShape - The shape to query.
-	 * @param MergeResult - The result of the merge that most recently happened.
-	 * @param SeachDeapth - How many iterations into the future to search.
+	 * Creates the candidates of a frozen socket. A frozen socket has no collapses, and is only re-checked when a merge changes its own edge, meaning the vertex at its start or the vertex at its end.
+	 *
+	 * @return Empty candidates that depend on the socket's own edge.
+	 */
+	static FTerrainSocketCandidates MakeFrozen()
+	{
+		FTerrainSocketCandidates FrozenCandidates = FTerrainSocketCandidates();
+
+		//The vertex at the start of a socket is always covered, so reaching one vertex after it covers the vertex at its end.
+		FrozenCandidates.ReachAfter = 1;
+		return FrozenCandidates;
+	}
+
+	/**
+	 * Chooses a candidate by weight. Each solver tile is chosen by its weight, then each of its possible faces is equally likely. Single tiles are only chosen where no macro tile fits.
+	 *
+	 * @param RandomStream - The random stream used to choose.
+	 * @return The solver tile and face of the chosen candidate. Must not be called if there are no candidates.
+	 */
+	FIntPoint Sample(FRandomStream& RandomStream) const
+	{
+		const int Column = RandomStream.RandHelper(Candidates.Num());
+		return Candidates[RandomStream.GetFraction() < Probabilities[Column] ? Column : Aliases[Column]];
+	}
+
+	/**
+	 * Gets the number of possible collapses.
+	 *
+	 * @return The number of possible collapses.
 	 */
-	bool HasNewCollapseableSuperPositions(FTerrainShape NewShape, FTerrainShapeMergeResult MergeResult, int SearchDepth = 0) const;
+	int Num() const
+	{
+		return Candidates.Num();
+	}
 
 	/**
-	 * Refreshes superpositions after a given change in vertices.
+	 * Determines whether there are no possible collapses.
 	 *
-	 * @param ShapeVertexGrowth = The number of new vertices in the shape.
-	 * @param ShapeVertexShrinkage = The number of old vertices removed from the shape.
-	 * @param ShapeVertexOffset = The shift in vertex index.
+	 * @return Whether or not there are no possible collapses.
 	 */
-	void RefreshSuperPositions(int ShapeVertexGrowth, int ShapeVertexShrinkage = 0, int ShapeVertexOffset = 0);
+	bool IsEmpty() const
+	{
+		return Candidates.IsEmpty();
+	}
 };
 
-/* /\ ========================= /\ *\
-|  /\ FTerrainGenerationWorker  /\  |
-\* /\ ========================= /\ */
\ No newline at end of file
+/* /\ ========================== /\ *\
+|  /\ FTerrainSocketCandidates  /\  |
+\* /\ ========================== /\ */
+
+
+
+/* \/ ==================== \/ *\
+|  \/ FTerrainFrozenSpan  \/  |
+\* \/ ==================== \/ */
+
+/**
+ * A run of frozen sockets taken out of the shape of the terrain, so that the steps of the solver do not pay for them. The socket before the run is left in the shape, with a face that never connects, to stand in for it.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainFrozenSpan
+{
+	//The socket of the shape standing in for the span. Its face joins the vertex before the span to the vertex after it.
+	int SocketIndex = 0;
+
+	//The type of the face of the standing in socket before the span was taken out.
+	FName SocketType = FName();
+
+	//The vertices taken out of the shape, in order. They come after the vertex of the standing in socket.
+	TArray<FTerrainVertex> Vertices = TArray<FTerrainVertex>();
+
+	//The bounds of the midpoints of the sockets taken out, along with the standing in socket.
+	FBox2D Bounds = FBox2D(ForceInit);
+
+	/**
+	 * Gets the type of the face of a socket standing in for a span. No tile has a face of this type, so nothing merges with it.
+	 *
+	 * @return The type of the face of a standing in socket.
+	 */
+	static FName GetSocketType()
+	{
+		static const FName FrozenSpanSocketType = FName(TEXT("PTT_FrozenSpan"));
+		return FrozenSpanSocketType;
+	}
+};
+
+/* /\ ==================== /\ *\
+|  /\ FTerrainFrozenSpan  /\  |
+\* /\ ==================== /\ */
+
+
+
+/* \/ ====================== \/ *\
+|  \/ FTerrainSegmentMerge  \/  |
+\* \/ ====================== \/ */
+
+/**
+ * A merge found on its own segment of the shape, described by the vertices of the shape before its batch that it replaces. Merges of disjoint segments are found on several threads and spliced in together.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainSegmentMerge
+{
+	//The first vertex of the shape that the merge replaces.
+	int FirstMergedVertex = 0;
+
+	//The number of vertices of the shape that the merge removes, starting at the first merged vertex. The vertex after them is kept, but its angle changes.
+	int Shrinkage = 0;
+
+	//The vertices of the merged tile, in order. They go just before the last merged vertex.
+	TArray<FTerrainVertex> NewVertices = TArray<FTerrainVertex>();
+
+	//The last merged vertex, which is the vertex after the removed ones, with its changed angle.
+	FTerrainVertex LastMergedVertex = FTerrainVertex();
+};
+
+/* /\ ====================== /\ *\
+|  /\ FTerrainSegmentMerge  /\  |
+\* /\ ====================== /\ */
+
+
+
+/* \/ ========================= \/ *\
+|  \/ FTerrainCollapseContext  \/  |
+\* \/ ========================= \/ */
+
+/**
+ * A read-only view of the state of the solver given to collapse modes. Refers to the worker's state rather than copying it, so must not outlive the step it was made for.
+ */
+struct PROCEDUALTERRAINTOOL_API FTerrainCollapseContext
+{
+	//The current shape of the terrain.
+	const FTerrainShape& Shape;
+
+	//The current superposition states of the terrain. Indexed by socket, then solver tile, then face.
+	const TArray<TArray<TArray<bool>>>& SuperPositions;
+
+	//The possible collapses of each socket, ready to be chosen from by weight.
+	const TArray<FTerrainSocketCandidates>& SocketCandidates;
+
+	//The sockets that are not frozen, in order. Frozen sockets have no superpositions and are never collapsed, so modes only search these.
+	const TArray<int>& ActiveSockets;
+
+	//The active sockets sorted by the running mode's socket order. Empty unless the running mode uses a socket order.
+	const TArray<int>& OrderedSockets;
+
+	//The solver tiles that can be spawned.
+	const FTerrainTileCatalog& TileCatalog;
+
+	/**
+	 * Creates a view of the given solver state.
+	 *
+	 * @param CurrentShape - The current shape of the terrain.
+	 * @param CurrentSuperPositions - The current superposition states of the terrain.
+	 * @param CurrentSocketCandidates - The possible collapses of each socket.
+	 * @param CurrentActiveSockets - The sockets that are not frozen.
+	 * @param CurrentOrderedSockets - The active sockets sorted by the running mode's socket order.
+	 * @param CurrentTileCatalog - The solver tiles that can be spawned.
+	 */
+	FTerrainCollapseContext(const FTerrainShape& CurrentShape, const TArray<TArray<TArray<bool>>>& CurrentSuperPositions, const TArray<FTerrainSocketCandidates>& CurrentSocketCandidates, const TArray<int>& CurrentActiveSockets, const TArray<int>& CurrentOrderedSockets, const FTerrainTileCatalog& CurrentTileCatalog) :
+		Shape(CurrentShape),
+		SuperPositions(CurrentSuperPositions),
+		SocketCandidates(CurrentSocketCandidates),
+		ActiveSockets(CurrentActiveSockets),
+		OrderedSockets(CurrentOrderedSockets),
+		TileCatalog(CurrentTileCatalog)
+	{
+
+	}
+
+	/**
+	 * Gets the number of sockets on the terrain.
+	 *
+	 * @return The number of sockets on the terrain.
+	 */
+	int NumSockets() const
+	{
+		return Shape.Num();
+	}
+
+	/**
+	 * Gets the midpoint of a socket.
+	 *
+	 * @param SocketIndex - The socket to locate.
+	 * @return The midpoint of the socket, in terrain space.
+	 */
+	FVector2D GetSocketLocation(const int SocketIndex) const
+	{
+		return (Shape.Vertices[SocketIndex].Location + Shape.Vertices[(SocketIndex + 1) % Shape.Num()].Location) / 2;
+	}
+
+	/**
+	 * Gets how enclosed a socket is by the tiles already placed. Collapsing the most enclosed sockets first fills gaps in the frontier rather than lengthening it.
+	 *
+	 * @param SocketIndex - The socket to check.
+	 * @return The interior angles at both ends of the socket as a fraction of two full turns, from 0 to 1.
+	 */
+	float GetSocketConcavity(const int SocketIndex) const
+	{
+		return (Shape.Vertices[SocketIndex].Angle + Shape.Vertices[(SocketIndex + 1) % Shape.Num()].Angle) / (4 * PI);
+	}
+
+	/**
+	 * Finds the active socket whose midpoint is closest to a location.
+	 *
+	 * @param Location - The location to search from, in terrain space.
+	 * @param OutDistanceSquared - Set to the squared distance between the location and the closest socket.
+	 * @return The index of the closest socket, or INDEX_NONE if the terrain has no active sockets.
+	 */
+	int FindClosestSocket(const FVector2D Location, float& OutDistanceSquared) const;
+
+	/**
+	 * Determines whether collapsing a socket cannot change the superpositions of any of the given collapses, so that they can all be made before the next refresh.
+	 *
+	 * @param SocketIndex - The socket to check.
+	 * @param Collapses - The collapses already chosen.
+	 * @return Whether or not the vertices the socket's merges depend on are disjoint from those of every chosen collapse.
+	 */
+	bool IsIndependentOf(const int SocketIndex, const TArray<FIntVector>& Collapses) const;
+};
+
+/* /\ ========================= /\ *\
+|  /\ FTerrainCollapseContext  /\  |
+\* /\ ========================= /\ */
+
+
+
+/* \/ ================== \/ *\
+|  \/ ATerrainGenerator  \/  |
+\* \/ ================== \/ */
+
+/**
+ * A tool for generating terrain. Takes in a set of tiles and can connect them together to form terrain.
+ */
+UCLASS()
+class PROCEDUALTERRAINTOOL_API ATerrainGenerator : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Sets up the root component.
+	 */
+	ATerrainGenerator();
+
+	/**
+	 * Ends the generation and waits for the retiring worker to stop without spawning its last tiles, so that no worker outlives the world.
+	 *
+	 * @param EndPlayReason - Why play is ending.
+	 */
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/**
+	 * Deletes the workers without spawning their last tiles. Editor actors are destroyed without ending play, and their world may already be gone.
+	 */
+	virtual void BeginDestroy() override;
+
+	/**
+	 * Temporary function that can be used to debug the terrain generator.
+	 */
+	UFUNCTION(/*CallInEditor, BlueprintCallable,*/ Meta = (Category = "Terrain Generator"))
+	void Test();
+
+	/**
+	 * Begins the terrain generation process. Reuses the running worker if its tiles and settings have not changed.
+	 */
+	UFUNCTION(CallInEditor, BlueprintCallable, Meta = (Category = "Terrain Generator"))
+	void BeginGeneration();
+
+	/**
+	 * Places a single tile as close to a location as possible without restarting the worker.
+	 *
+	 * @param Location - Where to place the tile, in world space.
+	 * @param TileIndex - The index of the spawnable tile to place.
+	 */
+	UFUNCTION(BlueprintCallable, Meta = (Category = "Terrain Generator"))
+	void PlaceTile(FVector Location, int TileIndex);
+
+	/**
+	 * Pauses the generation without discarding any progress. Tiles can still be placed while paused.
+	 */
+	UFUNCTION(CallInEditor, BlueprintCallable, Meta = (Category = "Terrain Generator"))
+	void PauseGeneration();
+
+	/**
+	 * Resumes a paused generation.
+	 */
+	UFUNCTION(CallInEditor, BlueprintCallable, Meta = (Category = "Terrain Generator"))
+	void ResumeGeneration();
+
+	/**
+	 * Stops the generation before the terrain is finished generating. Returns immediately, the worker finishes stopping in the background.
+	 */
+	UFUNCTION(CallInEditor, BlueprintCallable, Meta = (Category = "Terrain Generator"))
+	void EndGeneration();
+
+	/**
+	 * Resets the generation process and deletes all actors already spawned.
+	 */
+	UFUNCTION(CallInEditor, BlueprintCallable, Meta = (Category = "Terrain Generator"))
+	void Reset();
+
+	/**
+	 * Gets the latest shape of the terrain without copying it. Safe to call while the terrain is generating.
+	 *
+	 * @return An immutable snapshot of the shape of the terrain.
+	 */
+	FTerrainShapeSnapshot GetTerrainShapeSnapshot() const;
+
+	/**
+	 * Gets how quickly the current generation is filling its area.
+	 *
+	 * @return A snapshot of the generation progress. Empty if nothing is generating.
+	 */
+	struct FTerrainGenerationProgress GetGenerationProgress() const;
+
+
+	//The set of tiles that this will use when generating terrain.
+	UPROPERTY(EditAnywhere, Meta = (Category = "Terrain Generator"))
+	TArray<FTerrainTileSpawnData> SpawnableTiles;
+
+	//The method and shape in which the terrain will be generated.
+	UPROPERTY(EditAnywhere, Instanced, Meta = (Category = "Terrain Generator"))
+	UProcedualCollapseMode* GenerationMode = nullptr;
+
+	//The method and shape in which the terrain will be generated.
+	UPROPERTY(EditAnywhere, Meta = (Category = "Terrain Generator"))
+	bool bGenerateUntilSuccessful = false;
+
+	//How many steps into the future to look when generating terrain. Higher numbers slow generation but reduce risk of generation failure.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0", ClampMax = "4", Category = "Terrain Generator"))
+	int PredictionDepth = 0;
+
+	//Whether or not to only look ahead at sockets with few remaining options, deepening one step at a time until the node budget is used.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator", EditCondition = "PredictionDepth > 0"))
+	bool bAdaptivePrediction = false;
+
+	//Sockets with fewer options than this will be searched up to the prediction depth. All other sockets will not be looked ahead from.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "1", Category = "Terrain Generator", EditCondition = "PredictionDepth > 0 && bAdaptivePrediction"))
+	int AdaptivePredictionThreshold = 4;
+
+	//The maximum number of merges tested while looking ahead after a single collapse. 0 means no limit.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0", Category = "Terrain Generator", EditCondition = "PredictionDepth > 0"))
+	int PredictionNodeBudget = 0;
+
+	//Whether or not to reject collapses that leave a gap no combination of tile corners can fill.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator"))
+	bool bPruneUnfillableAngles = true;
+
+	//How attempts that stop making progress are restarted when generating until successful.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator", EditCondition = "bGenerateUntilSuccessful"))
+	ETerrainRestartSchedule RestartSchedule = ETerrainRestartSchedule::Luby;
+
+	//The number of seconds without a successful collapse before the first attempt is restarted. Later attempts scale this by the restart schedule.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0.1", Category = "Terrain Generator", EditCondition = "bGenerateUntilSuccessful && RestartSchedule != ETerrainRestartSchedule::None"))
+	float RestartUnitTime = 2;
+
+	//How much the stall budget grows after each restart when using the geometric schedule.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "1", Category = "Terrain Generator", EditCondition = "bGenerateUntilSuccessful && RestartSchedule == ETerrainRestartSchedule::Geometric"))
+	float RestartGrowthFactor = 1.5;
+
+	//The minimum area filled per second once an attempt has used its stall budget. Slower attempts are restarted. 0 disables the check.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0", Category = "Terrain Generator", EditCondition = "bGenerateUntilSuccessful && RestartSchedule != ETerrainRestartSchedule::None"))
+	float MinimumFillRate = 0;
+
+	//How much solver time this generator gets relative to other generators sharing the generation threads.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0.1", Category = "Terrain Generator"))
+	float GenerationPriority = 1;
+
+	//Whether or not to generate in time slices on the game thread instead of on the shared generation threads. Always used when the platform does not support multithreading.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator"))
+	bool bGenerateOnGameThread = false;
+
+	//The number of milliseconds spent generating on the game thread each frame. At least one collapse is made every frame.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0.1", Category = "Terrain Generator", EditCondition = "bGenerateOnGameThread"))
+	float GameThreadBudget = 4;
+
+	//The most tiles placed by a generation mode between refreshes of the superpositions. Only tiles far enough apart on the edge of the terrain to not affect each other are placed together.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "1", Category = "Terrain Generator"))
+	int CollapseBatchSize = 8;
+
+	//Whether or not to merge the tiles of a batch and re-evaluate the sockets they change on several threads at once. Lets a single large generation use more than one core, but uses the engine's worker threads rather than only the generation threads.
+	//Tiles whose merges depend on the same part of the edge of the terrain are still merged one at a time, so the terrain generated from a seed is the same however the threads run, but differs from the terrain generated without this.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator"))
+	bool bParallelRefresh = false;
+
+	//How often in seconds the generator publishes the shape of the terrain while generating. 0 publishes after every collapse.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0", Category = "Terrain Generator"))
+	float FrontierSnapshotInterval = 0.1;
+
+	//Whether or not to use the manually entered seed when generating terrain.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator", EditCondition = "!bGenerateUntilSuccessful"))
+	bool bUseManualSeed = false;
+
+	//Whether or not to use the manually entered seed when generating terrain.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator", EditCondition = "!bGenerateUntilSuccessful && bUseManualSeed"))
+	FRandomStream Seed = FRandomStream(0);
+
+	//Whether or not to derive the random decisions of each step from the seed and the step's index rather than from one sequential stream. Any step can then be reproduced on its own.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator"))
+	bool bCounterBasedRandom = false;
+
+	//The most clusters of tiles found by sampling to place as single macro tiles, so that large areas take fewer steps. Single tiles are only placed where no macro tile fits. 0 disables sampling.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "0", Category = "Terrain Generator"))
+	int MacroTileCount = 0;
+
+	//The most tiles in a macro tile found by sampling.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (ClampMin = "2", ClampMax = "6", Category = "Terrain Generator", EditCondition = "MacroTileCount > 0"))
+	int MaxMacroTileSize = 4;
+
+	//Groups of spawnable tiles to fit together and place as single macro tiles, in addition to those found by sampling.
+	UPROPERTY(EditAnywhere, AdvancedDisplay, Meta = (Category = "Terrain Generator"))
+	TArray<FTerrainMacroTileGroup> MacroTileGroups;
+
+private:
+
+	/**
+	 * Spawns any new tiles created by the worker and shuts down worker if complete. Called on the game thread whenever the worker has an update.
+	 */
+	UFUNCTION(Meta = (Category = "Terrain Generator"))
+	void RefreshTiles();
+
+	/**
+	 * Restarts the generation if it has stalled according to the restart schedule.
+	 */
+	UFUNCTION(Meta = (Category = "Terrain Generator"))
+	void CheckForStall();
+
+	/**
+	 * Runs a game thread worker for one frame's budget and spawns its new tiles. Reschedules itself while there is work left.
+	 */
+	UFUNCTION(Meta = (Category = "Terrain Generator"))
+	void RunGameThreadSlice();
+
+	/**
+	 * Gives a command to the worker, and makes sure a game thread worker gets a slice to carry it out.
+	 *
+	 * @param Command - The command to carry out.
+	 */
+	void EnqueueCommand(const struct FTerrainGenerationCommand& Command);
+
+	/**
+	 * Makes sure there is a worker compiled for the current tiles and settings, creating a new one if needed.
+	 *
+	 * @return Whether or not there is a worker to give commands to.
+	 */
+	bool EnsureGenerationWorker();
+
+	/**
+	 * Spawns the tiles a worker has placed and records the errors it has reported since they were last read.
+	 *
+	 * @param Worker - The worker to read from.
+	 */
+	void ReadWorkerOutput(class FTerrainGenerationWorker* Worker);
+
+	/**
+	 * Applies the final results of the retiring worker and deletes it once the scheduler has released it.
+	 */
+	void FinishRetiringWorker();
+
+	/**
+	 * Blocks until the retiring worker has stopped and applies its results. Bounded by the worker's cancellation latency.
+	 */
+	void WaitForRetiringWorker();
+
+	/**
+	 * Spawns a single tile.
+	 * 
+	 * @param TileData - The data needed to know where and what to spawn.
+	 */
+	UFUNCTION()
+	void SpawnTile(FTerrainTileInstanceData TileData);
+
+	/**
+	 * Determines whether the current attempt has stalled according to the restart schedule.
+	 *
+	 * @return Whether or not the current attempt should be abandoned and reseeded.
+	 */
+	bool ShouldRestartGeneration() const;
+
+	/**
+	 * Abandons the current attempt and begins a new one with a new seed.
+	 */
+	void RestartGeneration();
+
+	//A long lived asynchronous worker used to collapse superpositions and generate terrain without freezing the editor.
+	class FTerrainGenerationWorker* TerrainGenerationWorker;
+
+	//A stopped worker whose last time slice is still finishing in the background. Shared with its teardown, so that the teardown deletes it if this is destroyed first.
+	TSharedPtr<class FTerrainGenerationWorker, ESPMode::ThreadSafe> RetiringWorker;
+
+	//Completes once the scheduler has released the retiring worker.
+	TFuture<void> RetiringWorkerTeardown;
+
+	//Whether or not the results of the retiring worker should be thrown away.
+	bool bDiscardRetiringWorker = false;
+
+	//The shape of the terrain when generation last stopped.
+	UPROPERTY()
+	FTerrainShape TerrainShape = FTerrainShape();
+
+	//The latest published shape of the terrain.
+	FTerrainShapeSnapshot TerrainShapeSnapshot;
+
+	//The timer that periodically checks whether the generation has stalled.
+	UPROPERTY()
+	FTimerHandle StallCheckTimerHandle;
+
+	//The timer that runs the next slice of a game thread worker.
+	UPROPERTY()
+	FTimerHandle GameThreadSliceTimerHandle;
+
+	//The number of tiles currently spawned.
+	UPROPERTY()
+	int NumberOfTilesSpawned = 0;
+
+	//All of the actors spawned by this.
+	UPROPERTY()
+	TSet<AActor*> TileActors = TSet<AActor*>();
+
+	//The number of times the current generation has been restarted.
+	UPROPERTY(Transient)
+	int RestartCount = 0;
+};
+
+/* /\ ================== /\ *\
+|  /\ ATerrainGenerator  /\  |
+\* /\ ================== /\ */
+
+
+/* \/ ========================= \/ *\
+|  \/ FTerrainGenerationWorker  \/  |
+\* \/ ========================= \/ */
+
+/**
+ * How a FTerrainGenerationWorker looks ahead for failed superpositions.
+ */
+struct FTerrainLookaheadSettings
+{
+	//How many iterations into the future to search for failed superpositions.
+	int MaxDepth = 0;
+	//Whether or not to only deepen the search at sockets with few remaining options.
+	bool bAdaptive = false;
+	//Sockets with fewer options than this will be searched up to the max depth when adaptive.
+	int AdaptiveThreshold = 4;
+	//The maximum number of merges tested while looking ahead after a single collapse. 0 means no limit.
+	int NodeBudget = 0;
+	//Whether or not to reject collapses that leave a gap no combination of tile corners can fill.
+	bool bPruneUnfillableAngles = true;
+
+	bool operator==(const FTerrainLookaheadSettings& OtherSettings) const
+	{
+		return MaxDepth == OtherSettings.MaxDepth && bAdaptive == OtherSettings.bAdaptive && AdaptiveThreshold == OtherSettings.AdaptiveThreshold && NodeBudget == OtherSettings.NodeBudget && bPruneUnfillableAngles == OtherSettings.bPruneUnfillableAngles;
+	}
+};
+
+/**
+ * Everything a FTerrainGenerationWorker needs from its generator, copied on the game thread so that the worker never touches a UObject.
+ */
+struct FTerrainSolverConfig
+{
+	//The definition of each spawnable tile.
+	TArray<FTerrainTileDefinition> Tiles = TArray<FTerrainTileDefinition>();
+	//How to search for failed superpositions in the future.
+	FTerrainLookaheadSettings Lookahead = FTerrainLookaheadSettings();
+	//How often in seconds to publish the shape of the terrain.
+	float ShapeSnapshotInterval = 0.1;
+	//The most collapses to make between refreshes of the superpositions.
+	int CollapseBatchSize = 1;
+	//Whether or not to commit the collapses of a batch and re-evaluate stale sockets on several threads at once.
+	bool bParallelRefresh = false;
+	//Whether or not to derive the random decisions of each step from the seed and the step's index.
+	bool bCounterBasedRandom = false;
+	//How to find clusters of tiles to place as single macro tiles.
+	FTerrainMacroTileSettings MacroTiles = FTerrainMacroTileSettings();
+
+	bool operator==(const FTerrainSolverConfig& OtherConfig) const
+	{
+		return Tiles == OtherConfig.Tiles && Lookahead == OtherConfig.Lookahead && ShapeSnapshotInterval == OtherConfig.ShapeSnapshotInterval && CollapseBatchSize == OtherConfig.CollapseBatchSize && bParallelRefresh == OtherConfig.bParallelRefresh && bCounterBasedRandom == OtherConfig.bCounterBasedRandom && MacroTiles == OtherConfig.MacroTiles;
+	}
+};
+
+/**
+ * The parts of setting up a FTerrainGenerationWorker in the order they are carried out. A part may be spread over several slices.
+ */
+enum class ETerrainInitializationPhase : uint8
+{
+	//Compile the tiles into solver tiles.
+	CompileTiles,
+	//Grow clusters of the solver tiles to find the macro tiles.
+	SampleMacroTiles,
+	//Build the superpositions of an empty frontier, or set up the refresh of a resumed one.
+	BuildSuperPositions,
+	//Refresh a resumed frontier a batch of sockets at a time.
+	RefreshFrontier,
+	//Ready to carry out commands.
+	Done,
+};
+
+/**
+ * The kinds of command a FTerrainGenerationWorker carries out.
+ */
+enum class ETerrainGenerationCommandType : uint8
+{
+	//Collapse the superpositions chosen by a collapse mode until the mode is done.
+	RunMode,
+	//Collapse a single superposition at the socket closest to a location.
+	PlaceTile,
+	//Suspend the mode being run. Tiles can still be placed while paused.
+	Pause,
+	//Continue the mode being run.
+	Resume,
+};
+
+/**
+ * A request for a FTerrainGenerationWorker to change the terrain.
+ */
+struct FTerrainGenerationCommand
+{
+	//What to do.
+	ETerrainGenerationCommandType Type = ETerrainGenerationCommandType::RunMode;
+	//The mode to run, or the mode providing the transform of a placed tile.
+	FTerrainCollapseModeConfigPtr Mode = FTerrainCollapseModeConfigPtr();
+	//Where to place a tile, in world space.
+	FVector Location = FVector::ZeroVector;
+	//The index of the spawnable tile to place.
+	int TileIndex = 0;
+};
+
+/**
+ * A snapshot of how quickly a FTerrainGenerationWorker is filling its area.
+ */
+struct FTerrainGenerationProgress
+{
+	//The number of tiles placed so far.
+	int TilesPlaced = 0;
+	//The total area of the tiles placed so far.
+	double AreaFilled = 0;
+	//The number of seconds since the worker started.
+	double ElapsedTime = 0;
+	//The number of seconds since the last successful collapse.
+	double TimeSinceLastCollapse = 0;
+	//The number of merges tested while looking ahead during the most recent refresh.
+	int LastStepLookaheadNodes = 0;
+	//The largest number of merges tested while looking ahead during a single refresh.
+	int PeakStepLookaheadNodes = 0;
+	//The number of steps the current mode has run.
+	int Steps = 0;
+	//The number of sockets of the frontier after the most recent step. Frozen sockets taken out of the frontier are not counted, since steps do not pay for them.
+	int LastStepFrontierLength = 0;
+	//The number of sockets of the frontier that were not frozen after the most recent step.
+	int LastStepActiveFrontierLength = 0;
+	//The largest number of sockets of the frontier after a single step.
+	int PeakStepFrontierLength = 0;
+	//The number of sockets of the frontier after each step, summed over every step.
+	int64 TotalStepFrontierLength = 0;
+
+	/**
+	 * Gets the average area filled per second.
+	 *
+	 * @return The average area filled per second.
+	 */
+	double GetFillRate() const
+	{
+		return ElapsedTime > 0 ? AreaFilled / ElapsedTime : 0;
+	}
+
+	/**
+	 * Gets the average number of sockets of the frontier after each step.
+	 *
+	 * @return The average number of sockets of the frontier after each step.
+	 */
+	double GetAverageFrontierLength() const
+	{
+		return Steps > 0 ? (double)TotalStepFrontierLength / Steps : 0;
+	}
+};
+
+/**
+ * Asynchronously generates terrain out of a given set of tiles. Keeps its compiled tiles and superpositions between commands. Run in time slices by the FTerrainGenerationScheduler.
+ */
+class FTerrainGenerationWorker
+{
+	friend class FTerrainGenerationScheduler;
+
+public:
+	/**
+	 * Queues a command to be carried out after the commands already queued. Must only be called from one thread.
+	 *
+	 * @param Command - The command to carry out.
+	 */
+	void EnqueueCommand(const FTerrainGenerationCommand& Command);
+
+	/**
+	 * Determines whether this was created with the given config.
+	 *
+	 * @param SolverConfig - The config to compare against.
+	 * @param bShouldUseScheduler - Whether or not the new commands should be run by the scheduler.
+	 * @return Whether or not new commands for this config can be given to this.
+	 */
+	bool CanContinueWith(const FTerrainSolverConfig& SolverConfig, const bool bShouldUseScheduler) const;
+
+	/**
+	 * Determines whether this is run by the scheduler rather than by its owner calling RunSlice.
+	 *
+	 * @return Whether or not this is run by the scheduler.
+	 */
+	bool UsesScheduler() const;
+
+	/**
+	 * Determines whether the mode being run is paused.
+	 *
+	 * @return Whether or not the mode being run is paused.
+	 */
+	bool IsPaused() const;
+
+	/**
+	 * Sets how much solver time this gets relative to other workers.
+	 *
+	 * @param NewPriority - The multiplier applied to the scheduler's time slice.
+	 */
+	void SetPriority(const float NewPriority);
+
+	/**
+	 * Moves the results of the superposition collapses made since the last call into the given array. Must only be called from one thread.
+	 * 
+	 * @param OutTiles - Will have the new results appended to it.
+	 * @return The number of new results.
+	 */
+	int DequeueTerrainTiles(TArray<FTerrainTileInstanceData>& OutTiles);
+
+	/**
+	 * Takes the location of the oldest error reported since the last call. Must only be called from one thread.
+	 *
+	 * @param OutLocation - Set to the location of the error, in world space.
+	 * @return Whether or not there was an error to take.
+	 */
+	bool DequeueErrorLocation(FVector& OutLocation);
+
+	/**
+	 * Gets the random stream used to generate the terrain. Only safe to call once nothing is running this.
+	 *
+	 * @return The random stream in its current state.
+	 */
+	FRandomStream GetRandomStream() const;
+
+	/**
+	 * Gets the most recently published shape of the terrain without copying it.
+	 * 
+	 * @return An immutable snapshot of the shape of the terrain.
+	 */
+	FTerrainShapeSnapshot GetTerrainShapeSnapshot() const;
+
+	/**
+	 * Determines whether the terrain is finished generating, meaning every queued command has been carried out.
+	 *
+	 * @return Whether or not the terrain is finished generating.
+	 */
+	bool IsTerrainFinishedGenerating() const;
+
+	/**
+	 * Gets how quickly the terrain is being filled.
+	 *
+	 * @return A snapshot of the generation progress.
+	 */
+	FTerrainGenerationProgress GetProgress() const;
+
+	/**
+	 * Acknowledges the latest update so that the next new tile or completion sends a new notification.
+	 */
+	void AcknowledgeUpdate();
+
+	/**
+	 * Creates a FTerrainGenerationWorker able to compute superposition collapses of the given tiles.
+	 *
+	 * @param SolverConfig - The tiles and settings that will be used to generate the terrain.
+	 * @param GenerationStream - The random stream to start generating with. Copied so that the worker owns its stream.
+	 * @param UpdateDelegate - Executed on the game thread when there are new tiles or generation has finished.
+	 * @param CurrentTerrainShape - The shape of the terrain to continue generating from.
+	 * @param bRunOnScheduler - Whether to be run by the scheduler. Otherwise the owner must call RunSlice itself.
+	 */
+	FTerrainGenerationWorker(const FTerrainSolverConfig& SolverConfig, const FRandomStream& GenerationStream, FSimpleDelegate UpdateDelegate, FTerrainShape CurrentTerrainShape = FTerrainShape(), const bool bRunOnScheduler = true);
+
+	/**
+	 * Stops and unschedules this.
+	 */
+	~FTerrainGenerationWorker();
+
+	/**
+	 * Carries out queued commands and runs the current mode until there is nothing left to do or the slice is used up.
+	 *
+	 * @param SliceDuration - How long to run for, in seconds. At least one step is always taken.
+	 * @return Whether or not there is still work to do.
+	 */
+	bool RunSlice(const double SliceDuration);
+
+	/**
+	 * Determines whether initialization, commands or an unpaused mode are waiting to be run.
+	 *
+	 * @return Whether or not this needs more time.
+	 */
+	bool HasWork() const;
+
+	/**
+	 * Stops the generation process regardless of completion.
+	 */
+	void Stop();
+
+	/**
+	 * Blocks until no scheduler thread is running this and publishes the final shape. Returns within a few milliseconds of Stop being called.
+	 */
+	void WaitForCompletion();
+
+private:
+	//Whether or not the task has been stopped prematurely.
+	std::atomic_bool bStopped;
+	//Executed on the game thread when there are new tiles or generation has finished.
+	FSimpleDelegate OnUpdate;
+	//Whether or not a notification has been sent that the game thread has not yet acknowledged.
+	std::atomic_bool bUpdatePending;
+
+
+	//Commands waiting to be carried out.
+	TQueue<FTerrainGenerationCommand, EQueueMode::Spsc> Commands;
+	//The number of commands queued but not yet carried out.
+	std::atomic<int> PendingCommands;
+	//Whether or not this is run by the scheduler rather than by its owner.
+	bool bUseScheduler;
+	//Whether or not this is waiting in or being run by the scheduler.
+	std::atomic_bool bScheduled;
+	//Triggered while the scheduler neither holds nor runs this. Reset and triggered by the scheduler under its lock.
+	FEvent* ReleasedEvent;
+	//The multiplier applied to the scheduler's time slice.
+	std::atomic<float> Priority;
+	//How far the tiles have been compiled and the initial superpositions built.
+	ETerrainInitializationPhase InitializationPhase;
+	//The first socket of a resumed frontier that has not been refreshed yet.
+	int NextInitialSocket;
+	//How many sockets of a resumed frontier to refresh at once. Sized by the last batch to fit in what is left of the slice.
+	int InitialRefreshBatchSize;
+	//The mode being run until it is done. Null if no mode is being run.
+	FTerrainCollapseModeConfigPtr RunningMode;
+	//Whether or not a mode is being run.
+	std::atomic_bool bRunning;
+	//Whether or not the mode being run is paused.
+	std::atomic_bool bPaused;
+
+
+	//The mode of the command being carried out.
+	FTerrainCollapseModeConfigPtr CollapseMode;
+	//The spawnable tile the command being carried out must place, or INDEX_NONE if any variant may be placed.
+	int RequiredTileIndex;
+	//The random stream used to make the decisions of the current step. Owned by this so that it is never shared between threads.
+	FRandomStream RandomStream;
+	//The stream the generator seeded this with. Only drawn from to create the counter key when generating with a counter-based random.
+	FRandomStream SeedStream;
+	//The key of every step's random decisions when generating with a counter-based random.
+	uint32 CounterKey;
+	//The number of steps that have made random decisions.
+	uint64 DecisionIndex;
+	//The tiles and settings that will be used to generate the terrain.
+	const FTerrainSolverConfig Config;
+	//The tiles that will be used to generate the terrain, compiled for the solver in the worker's first slice.
+	FTerrainTileCatalog TileCatalog;
+	//The superposition of an empty socket.
+	TArray<TArray<bool>> BaseSuperPositions;
+
+
+	//Will be written to as superpositions are collapsed and drained by the game thread.
+	TQueue<FTerrainTileInstanceData, EQueueMode::Spsc> NewTerrainTiles;
+	//The locations of errors, in world space. Drained by the game thread.
+	TQueue<FVector, EQueueMode::Spsc> NewErrorLocations;
+	//The current shape of the terrain.
+	FTerrainShape Shape;
+	//The most recently published shape of the terrain.
+	FTerrainShapeSnapshot ShapeSnapshot;
+	//Guards swapping the published shape of the terrain.
+	mutable FCriticalSection ShapeSnapshotLock;
+	//The time the shape of the terrain was last published, in seconds.
+	double LastSnapshotTime;
+	//Whether or not a given solver tile can connect to a given socket. SuperPositions[Socket to connect to][Solver tile to add][Socket on tile to connect to]. Only faces below the tile's symmetry period are ever set.
+	TArray<TArray<TArray<bool>>> SuperPositions = TArray<TArray<TArray<bool>>>();
+	//The possible collapses of each socket. Only rebuilt when the superpositions of their socket change.
+	TArray<FTerrainSocketCandidates> SocketCandidates = TArray<FTerrainSocketCandidates>();
+	//Whether or not the shape has been merged with since the superpositions were last refreshed.
+	bool bMergesPending;
+	//The socket each socket of the shape was at when the superpositions were last refreshed, or INDEX_NONE for new sockets.
+	TArray<int> PendingSourceSockets = TArray<int>();
+	//Where each socket of the shape at the last refresh has moved to, or INDEX_NONE if a merge removed it. The inverse of PendingSourceSockets.
+	TArray<int> PendingMovedSockets = TArray<int>();
+	//The sockets of the shape whose superpositions must be re-evaluated at the next refresh.
+	TBitArray<> PendingStaleSockets = TBitArray<>();
+	//The spare source sockets a merge writes to before swapping them with the pending ones, so that merges reuse their allocations.
+	TArray<int> MergedSourceSockets = TArray<int>();
+	//The spare stale sockets a merge writes to before swapping them with the pending ones.
+	TBitArray<> MergedStaleSockets = TBitArray<>();
+	//The earliest collapse of a batch committed on several threads that reserved each vertex of the shape. Kept between batches to reuse its allocation.
+	TArray<int32> VertexReservations = TArray<int32>();
+	//The mode whose bounds decide which sockets are frozen. Null if no sockets are frozen.
+	FTerrainCollapseModeConfigPtr FrozenBounds;
+	//The sockets outside of the frozen bounds. They keep their vertices so that the shape stays closed, but have no superpositions and are never refreshed. The middles of long runs of them are taken out into frozen spans.
+	TBitArray<> FrozenSockets = TBitArray<>();
+	//A socket outside of the frozen bounds that the next refresh thaws anyway so that a tile can be placed at it, or INDEX_NONE.
+	int ThawingSocket;
+	//The sockets that are not frozen, in order.
+	TArray<int> ActiveSockets = TArray<int>();
+	//The runs of frozen sockets taken out of the shape.
+	TArray<FTerrainFrozenSpan> FrozenSpans = TArray<FTerrainFrozenSpan>();
+	//The number of frozen sockets left in the shape when it was last compacted.
+	int FrozenSocketsAfterCompaction;
+	//The active sockets sorted by the socket order of the mode whose bounds are frozen, if it uses one. Kept sorted between refreshes rather than rebuilt.
+	TArray<int> OrderedSockets = TArray<int>();
+	//The socket order of each socket in OrderedSockets. Indexed by socket.
+	TArray<float> SocketOrders = TArray<float>();
+	//The time the current mode started running, in seconds.
+	std::atomic<double> StartTime;
+	//The time of the last successful collapse, in seconds.
+	std::atomic<double> LastCollapseTime;
+	//The number of tiles placed since the current mode started running.
+	std::atomic<int> TilesPlaced;
+	//The total area of the tiles placed since the current mode started running.
+	std::atomic<double> AreaFilled;
+	//The number of merges tested while looking ahead during the current refresh.
+	mutable std::atomic<int> LookaheadNodes;
+	//The number of merges tested while looking ahead during the most recent refresh.
+	std::atomic<int> LastRefreshLookaheadNodes;
+	//The largest number of merges tested while looking ahead during a single refresh.
+	std::atomic<int> PeakRefreshLookaheadNodes;
+	//The number of steps the current mode has run.
+	std::atomic<int> StepsRun;
+	//The number of sockets of the frontier after the most recent step.
+	std::atomic<int> LastStepFrontierLength;
+	//The number of sockets of the frontier that were not frozen after the most recent step.
+	std::atomic<int> LastStepActiveFrontierLength;
+	//The largest number of sockets of the frontier after a single step of the current mode.
+	std::atomic<int> PeakStepFrontierLength;
+	//The number of sockets of the frontier after each step of the current mode, summed.
+	std::atomic<int64> TotalStepFrontierLength;
+
+	/**
+	 * Compiles the tiles and builds the initial superpositions, picking up where the last slice left off. Stops between phases and batches once the slice is used up or this is stopped.
+	 *
+	 * @param SliceEnd - When the slice ends, in platform seconds. Every call makes some progress.
+	 * @return Whether or not initialization is done.
+	 */
+	bool Initialize(const double SliceEnd);
+
+	/**
+	 * Notifies the game thread that there are new tiles or that generation has finished. Only one notification is in flight at a time.
+	 */
+	void NotifyUpdate();
+
+	/**
+	 * Publishes an immutable copy of the current shape of the terrain.
+	 */
+	void PublishShapeSnapshot();
+
+	/**
+	 * Gets the current shape of the terrain with every frozen span put back.
+	 *
+	 * @return The whole shape of the terrain.
+	 */
+	FTerrainShape GetExpandedShape() const;
+
+	/**
+	 * Starts a new step of random decisions. When generating with a counter-based random, reseeds the random stream from the counter key and the step's index.
+	 */
+	void BeginDecision();
+
+	/**
+	 * Reports an error to the game thread.
+	 *
+	 * @param Location - The location of the error, in world space.
+	 */
+	void ReportError(const FVector Location);
+
+	/**
+	 * Gets the midpoint of a socket in world space.
+	 *
+	 * @param SocketIndex - The socket to locate.
+	 * @return The location of the socket, in world space.
+	 */
+	FVector GetSocketLocation(const int SocketIndex) const;
+
+	/**
+	 * Finds the socket whose midpoint is closest to a location, including frozen sockets. Puts back the frozen spans that could hold a closer socket than those left in the shape. Must not be called while merges are pending.
+	 *
+	 * @param Location - The location to search from, in terrain space.
+	 * @return The index of the closest socket, or 0 if the shape is empty.
+	 */
+	int GetClosestSocket(const FVector2D Location);
+
+	/**
+	 * Carries out every queued command.
+	 */
+	void ProcessCommands();
+
+	/**
+	 * Collapses the superposition chosen by the running mode.
+	 *
+	 * @return Whether or not the running mode needs another collapse.
+	 */
+	bool RunModeStep();
+
+	/**
+	 * Collapses a single superposition of the given tile at the socket closest to a location.
+	 *
+	 * @param Location - Where to place the tile, in world space.
+	 * @param TileIndex - The index of the spawnable tile to place.
+	 */
+	void PlaceTileAt(const FVector Location, const int TileIndex);
+
+	/**
+	 * Attempts to collapse a super position at a given index. 
+	 * 
+	 * @param Index - X = Socket to connect to, Y = Tile to add, Z = Socket on tile to connect to.
+	 * @return Whether or not the collapse was successful.
+	 */
+	bool CollapseSuperPosition(FIntVector Index);
+
+	/**
+	 * Collapses a batch of superpositions and refreshes the superpositions once for all of them. Collapses at sockets changed by an earlier collapse of the batch are skipped.
+	 * With parallel refreshes, collapses whose merges depend on disjoint parts of the shape are committed on several threads at once, and the rest are retried one at a time.
+	 *
+	 * @param Indices - The superpositions to collapse, indexed by the sockets of the shape before the batch. The first must be valid.
+	 * @return Whether or not the first collapse was successful.
+	 */
+	bool CollapseSuperPositionBatch(const TArray<FIntVector>& Indices);
+
+	/**
+	 * Merges a tile into the shape and records which sockets must be refreshed without refreshing them.
+	 *
+	 * @param Index - X = Socket of the current shape to connect to, Y = Tile to add, Z = Socket on tile to connect to.
+	 * @return Whether or not the merge was successful.
+	 */
+	bool CommitCollapse(FIntVector Index);
+
+	/**
+	 * Commits the collapses of a batch on several threads at once. Each collapse reserves the segment of the shape its merge depends on, and is committed only if no earlier collapse of the batch reserved any of the same vertices. The merges are found on copies of their own segments and spliced in together.
+	 *
+	 * @param Indices - The superpositions to collapse, indexed by the sockets of the shape before the batch. Must not be called while merges are pending.
+	 * @param Conflicts - Set to the possible collapses that were not committed, in batch order, to be retried one at a time.
+	 * @return Whether or not the first collapse was committed.
+	 */
+	bool CommitCollapsesConcurrently(const TArray<FIntVector>& Indices, TArray<FIntVector>& Conflicts);
+
+	/**
+	 * Chooses which of the equivalent faces of a symmetric tile to connect with. Tiles without symmetry have only one, so no random number is drawn for them.
+	 *
+	 * @param ShapeIndex - The solver tile being collapsed.
+	 * @param FaceIndex - The face of the superposition being collapsed.
+	 * @return The face of the tile to connect with.
+	 */
+	int ChooseEquivalentFace(const int ShapeIndex, const int FaceIndex);
+
+	/**
+	 * Queues the tiles of a collapsed solver tile to be spawned and counts them.
+	 *
+	 * @param ShapeIndex - The solver tile that was collapsed.
+	 * @param MergeResult - The result of merging it into the shape.
+	 */
+	void EnqueueCollapsedTiles(const int ShapeIndex, const FTerrainShapeMergeResult& MergeResult);
+
+	/**
+	 * Starts recording merges if none are pending, with every socket where it was at the last refresh.
+	 *
+	 * @param NumberOfSockets - The number of sockets of the shape at the last refresh.
+	 */
+	void BeginPendingMerges(const int NumberOfSockets);
+
+	/**
+	 * Records how a merge moved the sockets of the shape and marks the sockets it affected as stale.
+	 *
+	 * @param MergeResult - The result of the merge.
+	 * @param PreviousNumberOfSockets - The number of sockets of the shape before the merge.
+	 */
+	void RecordMerge(const FTerrainShapeMergeResult& MergeResult, const int PreviousNumberOfSockets);
+
+	/**
+	 * Replaces the segments of the shape changed by merges of disjoint segments, and records how the sockets moved and which sockets must be refreshed as RecordMerge would for each merge in turn.
+	 *
+	 * @param Merges - The merges to splice in. Their segments must not overlap, and they must be in order along the shape, starting from the one whose last merged vertex comes first. Must not be called while merges are pending.
+	 */
+	void SpliceSegmentMerges(const TArray<FTerrainSegmentMerge>& Merges);
+
+	/**
+	 * Determines whether a socket is inside of the frozen bounds.
+	 *
+	 * @param SocketIndex - The socket to check.
+	 * @return Whether or not the socket may still be collapsed.
+	 */
+	bool IsSocketInFrozenBounds(const int SocketIndex) const;
+
+	/**
+	 * Freezes the sockets outside of a mode's bounds and thaws the sockets inside of them. Must not be called while merges are pending.
+	 *
+	 * @param Bounds - The mode whose bounds to use. Null thaws every socket.
+	 */
+	void SetFrozenBounds(const FTerrainCollapseModeConfigPtr& Bounds);
+
+	/**
+	 * Freezes a single socket, dropping its superpositions. Does not update the active or ordered sockets.
+	 *
+	 * @param SocketIndex - The socket to freeze.
+	 */
+	void FreezeSocket(const int SocketIndex);
+
+	/**
+	 * Thaws a single frozen socket and re-evaluates it, even if it is outside of the frozen bounds. Must not be called while merges are pending.
+	 *
+	 * @param SocketIndex - The socket to thaw.
+	 */
+	void ThawSocket(const int SocketIndex);
+
+	/**
+	 * Rebuilds the list of sockets that are not frozen.
+	 */
+	void RebuildActiveSockets();
+
+	/**
+	 * Moves the active sockets to where the merges since the last refresh moved them and adds the refreshed sockets that are not frozen. Sockets that were not refreshed are still frozen or not, so only the refreshed sockets are checked.
+	 *
+	 * @param MovedSockets - Where each socket of the shape before the merges has moved to, or INDEX_NONE if it was removed.
+	 * @param StaleSockets - The sockets that were refreshed.
+	 */
+	void UpdateActiveSockets(const TArray<int>& MovedSockets, const TBitArray<>& StaleSockets);
+
+	/**
+	 * Determines whether a socket stands in for a frozen span.
+	 *
+	 * @param SocketIndex - The socket to check.
+	 * @return Whether or not the socket's face joins the ends of a frozen span.
+	 */
+	bool IsFrozenSpanSocket(const int SocketIndex) const;
+
+	/**
+	 * Gets how many frozen sockets are kept at each end of a frozen span. Twice as far as a merge at an active socket, along with its lookahead, can look along the frontier.
+	 *
+	 * @return The number of frozen sockets kept at each end of a frozen span.
+	 */
+	int GetFrozenSpanMargin() const;
+
+	/**
+	 * Takes the middle of every long run of frozen sockets out of the shape, keeping a margin at each end. The sockets left keep their order. Must not be called while merges are pending.
+	 */
+	void CompactFrozenSockets();
+
+	/**
+	 * Puts the sockets of frozen spans back into the shape. They stay frozen. Must not be called while merges are pending.
+	 *
+	 * @param SpanIndices - The spans to put back.
+	 */
+	void ExpandFrozenSpans(const TArray<int>& SpanIndices);
+
+	/**
+	 * Puts back the frozen spans that an active socket has come within half a margin of, before a merge can look past their ends.
+	 */
+	void ExpandFrozenSpansNearActiveSockets();
+
+	/**
+	 * Determines whether the mode whose bounds are frozen keeps its sockets sorted.
+	 *
+	 * @return Whether or not OrderedSockets is maintained.
+	 */
+	bool UsesSocketOrder() const;
+
+	/**
+	 * Sorts every active socket by the socket order of the mode whose bounds are frozen.
+	 */
+	void RebuildOrderedSockets();
+
+	/**
+	 * Moves the ordered sockets to where the merges since the last refresh moved them and inserts the refreshed sockets in order. Sockets that were not refreshed keep their order, so the sockets stay sorted.
+	 *
+	 * @param MovedSockets - Where each socket of the shape before the merges has moved to, or INDEX_NONE if it was removed.
+	 * @param StaleSockets - The sockets that were refreshed.
+	 */
+	void UpdateOrderedSockets(const TArray<int>& MovedSockets, const TBitArray<>& StaleSockets);
+
+	/**
+	 * Determines whether a superposition is possible in the superpositions last refreshed.
+	 *
+	 * @param Index - X = Socket to connect to, Y = Tile to add, Z = Socket on tile to connect to.
+	 * @return Whether or not the superposition is possible.
+	 */
+	bool IsSuperPositionPossible(const FIntVector Index) const;
+
+	/**
+	 * Whether or not there is an available super position to collapse after the given merge.
+	 * 
+	 * @param NewShape - The shape to query.
+	 * @param MergeResult - The result of the merge that most recently happened.
+	 * @param SeachDeapth - How many iterations into the future to search.
+	 * @param InspectedBefore - How many vertices before the first merged vertex the search inspected.
+	 * @param InspectedAfter - How many vertices after the last merged vertex the search inspected.
+	 */
+	bool HasNewCollapseableSuperPositions(FTerrainShape NewShape, FTerrainShapeMergeResult MergeResult, int SearchDepth, int& InspectedBefore, int& InspectedAfter) const;
+
+	/**
+	 * Whether or not every vertex changed by a merge leaves a gap that can still be filled.
+	 *
+	 * @param MergedShape - The shape after the merge.
+	 * @param MergeResult - The result of the merge.
+	 * @return Whether or not the merge leaves only fillable gaps.
+	 */
+	bool HasOnlyFillableAngles(const FTerrainShape& MergedShape, const FTerrainShapeMergeResult& MergeResult) const;
+
+	/**
+	 * Whether or not the lookahead node budget has been used up for the current refresh.
+	 *
+	 * @return Whether or not further lookahead should be limited to the sockets directly affected by a merge.
+	 */
+	bool IsLookaheadBudgetExhausted() const;
+
+	/**
+	 * Moves the superpositions to the sockets recorded by the merges since the last refresh and re-evaluates the stale sockets.
+	 */
+	void RefreshSuperPositions();
+};
+
+/* /\ ========================= /\ *\
+|  /\ FTerrainGenerationWorker  /\  |
+\* /\ ========================= /\ */
+
+
+
+/* \/ ============================ \/ *\
+|  \/ FTerrainGenerationScheduler  \/  |
+\* \/ ============================ \/ */
+
+/**
+ * A pool of threads shared by every FTerrainGenerationWorker. Workers with work take turns running for a time slice scaled by their priority.
+ */
+class FTerrainGenerationScheduler : public FRunnable
+{
+public:
+	/**
+	 * Gets the scheduler shared by all terrain generators. Only valid while the module is loaded.
+	 *
+	 * @return The shared scheduler.
+	 */
+	static FTerrainGenerationScheduler& Get();
+
+	/**
+	 * Determines whether the module's scheduler exists, which it does not after the module has shut down.
+	 *
+	 * @return Whether or not Get can be called.
+	 */
+	static bool IsAvailable();
+
+	/**
+	 * Creates the event used to wake the scheduler's threads. Created by the module when it starts up.
+	 */
+	FTerrainGenerationScheduler();
+
+	/**
+	 * Queues a worker to be given a time slice. The worker must be marked as scheduled.
+	 *
+	 * @param Worker - The worker with work to do.
+	 */
+	void Schedule(FTerrainGenerationWorker* Worker);
+
+	/**
+	 * Removes a worker waiting for a time slice.
+	 *
+	 * @param Worker - The worker to remove.
+	 */
+	void Unschedule(FTerrainGenerationWorker* Worker);
+
+	/**
+	 * Determines whether a worker is waiting for or running a time slice.
+	 *
+	 * @param Worker - The worker to query.
+	 * @return Whether or not the worker is waiting for or running a time slice.
+	 */
+	bool IsScheduled(FTerrainGenerationWorker* Worker) const;
+
+	/**
+	 * Replaces the scheduler's threads. Waits for the current time slices to end.
+	 *
+	 * @param NewThreadCount - The number of threads to run workers on. 0 picks a count based on the number of cores.
+	 */
+	void SetThreadCount(const int NewThreadCount);
+
+	/**
+	 * Stops all of the scheduler's threads until the next worker is scheduled.
+	 */
+	void Shutdown();
+
+	/**
+	 * Stops the threads and releases the workers still waiting when destroyed. Destroyed by the module when it shuts down.
+	 */
+	virtual ~FTerrainGenerationScheduler();
+
+
+	// \/ Begin FRunnable interface. \/ //
+
+	/**
+	 * Repeatedly gives the next waiting worker a time slice.
+	 *
+	 * @return 0
+	 */
+	virtual uint32 Run();
+
+	/**
+	 * Stops all of the scheduler's threads.
+	 */
+	virtual void Stop();
+
+	// /\  End FRunnable interface.  /\ //
+
+private:
+	/**
+	 * Starts the threads if they are not already running.
+	 */
+	void StartThreads();
+
+	/**
+	 * Takes the next worker waiting for a time slice and marks it as running.
+	 *
+	 * @return The next worker, or nullptr if none are waiting.
+	 */
+	FTerrainGenerationWorker* DequeueWorker();
+
+	/**
+	 * Requeues or releases a worker after its time slice.
+	 *
+	 * @param Worker - The worker that was run.
+	 * @param bHasMoreWork - Whether or not the worker still needs more time.
+	 */
+	void FinishSlice(FTerrainGenerationWorker* Worker, const bool bHasMoreWork);
+
+	//The number of threads to run workers on. 0 picks a count based on the number of cores.
+	int ThreadCount;
+	//The threads that run workers.
+	TArray<FRunnableThread*> Threads = TArray<FRunnableThread*>();
+	//Guards starting and stopping the threads.
+	FCriticalSection ThreadsLock;
+	//Whether or not the threads should exit.
+	std::atomic_bool bStopping;
+	//Triggered when a worker is queued or the threads are stopping.
+	FEvent* WorkEvent;
+
+	//Workers waiting for a time slice in the order they will be run.
+	TArray<FTerrainGenerationWorker*> ReadyWorkers = TArray<FTerrainGenerationWorker*>();
+	//Workers currently running a time slice.
+	TSet<FTerrainGenerationWorker*> RunningWorkers = TSet<FTerrainGenerationWorker*>();
+	//Guards the ready and running workers.
+	mutable FCriticalSection WorkersLock;
+
+	//The scheduler owned by the module. Null while the module is not loaded.
+	static FTerrainGenerationScheduler* Instance;
+};
+
+/* /\ ============================ /\ *\
+|  /\ FTerrainGenerationScheduler  /\  |
+\* /\ ============================ /\ */